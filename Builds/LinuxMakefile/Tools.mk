@@ -0,0 +1,60 @@
+# The headless tools, built from the same JUCE module objects as the app.
+#
+# This file is maintained by hand, and wraps the Makefile that the Projucer
+# generates, so re-saving the project can't lose these targets:
+#
+#   make -f Tools.mk CONFIG=Release render
+#   make -f Tools.mk CONFIG=Release bench
+
+include Makefile
+
+JUCE_TARGET_RENDER := AudioSynthesiserRender
+JUCE_TARGET_BENCH := AudioSynthesiserBench
+
+# The offline renderer has its own main() instead of Main.cpp.
+OBJECTS_RENDER := \
+  $(JUCE_OBJDIR)/RenderMain_3c0f8a21.o \
+  $(filter-out $(JUCE_OBJDIR)/Main_90ebc5c2.o, $(OBJECTS_APP)) \
+
+# So do the microbenchmarks.
+OBJECTS_BENCH := \
+  $(JUCE_OBJDIR)/BenchMain_7d2e41b6.o \
+  $(filter-out $(JUCE_OBJDIR)/Main_90ebc5c2.o, $(OBJECTS_APP)) \
+
+.PHONY: render bench clean-tools
+
+render : $(JUCE_OUTDIR)/$(JUCE_TARGET_RENDER)
+
+bench : $(JUCE_OUTDIR)/$(JUCE_TARGET_BENCH)
+
+$(JUCE_OUTDIR)/$(JUCE_TARGET_RENDER) : $(OBJECTS_RENDER) $(JUCE_OBJDIR)/execinfo.cmd
+	@echo Linking "AudioSynthesiserDemo - Offline Renderer"
+	-$(V_AT)mkdir -p $(JUCE_BINDIR)
+	-$(V_AT)mkdir -p $(JUCE_LIBDIR)
+	-$(V_AT)mkdir -p $(JUCE_OUTDIR)
+	$(V_AT)$(CXX) -o $(JUCE_OUTDIR)/$(JUCE_TARGET_RENDER) $(OBJECTS_RENDER) $(JUCE_LDFLAGS) $(shell cat $(JUCE_OBJDIR)/execinfo.cmd) $(TARGET_ARCH)
+
+$(JUCE_OUTDIR)/$(JUCE_TARGET_BENCH) : $(OBJECTS_BENCH) $(JUCE_OBJDIR)/execinfo.cmd
+	@echo Linking "AudioSynthesiserDemo - Benchmarks"
+	-$(V_AT)mkdir -p $(JUCE_BINDIR)
+	-$(V_AT)mkdir -p $(JUCE_LIBDIR)
+	-$(V_AT)mkdir -p $(JUCE_OUTDIR)
+	$(V_AT)$(CXX) -o $(JUCE_OUTDIR)/$(JUCE_TARGET_BENCH) $(OBJECTS_BENCH) $(JUCE_LDFLAGS) $(shell cat $(JUCE_OBJDIR)/execinfo.cmd) $(TARGET_ARCH)
+
+$(JUCE_OBJDIR)/RenderMain_3c0f8a21.o: ../../Source/RenderMain.cpp
+	-$(V_AT)mkdir -p $(@D)
+	@echo "Compiling RenderMain.cpp"
+	$(V_AT)$(CXX) $(JUCE_CXXFLAGS) $(JUCE_CPPFLAGS_APP) $(JUCE_CFLAGS_APP) -o "$@" -c "$<"
+
+$(JUCE_OBJDIR)/BenchMain_7d2e41b6.o: ../../Source/BenchMain.cpp
+	-$(V_AT)mkdir -p $(@D)
+	@echo "Compiling BenchMain.cpp"
+	$(V_AT)$(CXX) $(JUCE_CXXFLAGS) $(JUCE_CPPFLAGS_APP) $(JUCE_CFLAGS_APP) -o "$@" -c "$<"
+
+clean-tools:
+	@echo Cleaning the tools
+	$(V_AT)rm -f $(JUCE_OUTDIR)/$(JUCE_TARGET_RENDER) $(JUCE_OUTDIR)/$(JUCE_TARGET_BENCH)
+	$(V_AT)rm -f $(JUCE_OBJDIR)/RenderMain_3c0f8a21.* $(JUCE_OBJDIR)/BenchMain_7d2e41b6.*
+
+-include $(JUCE_OBJDIR)/RenderMain_3c0f8a21.d
+-include $(JUCE_OBJDIR)/BenchMain_7d2e41b6.d
@@ -13,38 +13,42 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "../../Source/StateVariableFilter.h"
 
 class FilterProcessor
 {
 public:
     FilterProcessor()
     {
+        prepare(44100.0, 2); // Default sample rate and channel count
         updateCoefficients(1000.0f, 0.7f); // Default cutoff and resonance
     }
 
+    /** Call this before processBlock() with the rate and channel count the buffers will have. */
+    void prepare(double sampleRate, int numChannels)
+    {
+        filter.prepare(sampleRate, numChannels);
+    }
+
+    // cheap enough to call every sample, and the filter stays stable however fast it moves
     void updateCoefficients(float cutoffFrequency, float resonance)
     {
-        auto sampleRate = 44100.0; // Assume a default sample rate
-        auto q = 1.0f / (2.0f * resonance);
+        filter.setCutoffFrequency(cutoffFrequency);
+        filter.setResonance(1.0f / (2.0f * resonance));
+    }
 
-        filterCoefficients = juce::IIRCoefficients::makeLowPass(sampleRate, cutoffFrequency, q);
-        filter.setCoefficients(filterCoefficients);
+    void setType(FilterType newType)
+    {
+        filter.setType(newType);
     }
 
     void processBlock(juce::AudioBuffer<float>& buffer)
     {
         juce::ScopedNoDenormals noDenormals;
-        auto totalNumInputChannels  = buffer.getNumChannels();
-
-        for (int channel = 0; channel < totalNumInputChannels; ++channel)
-        {
-            auto* channelData = buffer.getWritePointer(channel);
-            filter.processSamples(channelData, buffer.getNumSamples());
-        }
+        filter.process(buffer, 0, buffer.getNumSamples());
     }
 
 private:
-    juce::IIRFilter filter;
-    juce::IIRCoefficients filterCoefficients;
+    StateVariableFilter filter;
 };
 #endif /* FilterProcessor_h */
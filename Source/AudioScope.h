@@ -0,0 +1,392 @@
+/*
+  ==============================================================================
+
+    This file contains the demo's scope, which shows the synth's output as a
+    scrolling waveform or as a spectrum.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "DisplayTap.h"
+
+//==============================================================================
+/**
+    A scrolling waveform, or a spectrum, of the audio pushed into it, drawn as
+    cheaply as possible.
+
+    The audio thread only copies its blocks into a DisplayTap. Everything else is
+    done on the GUI thread, once per screen refresh or less:
+
+    - The waveform is kept in an image that's used as a ring of columns. Each
+      new column's min/max is drawn into it as it arrives, and painting is just
+      two unscaled blits of the image, so nothing that's already on screen is
+      ever redrawn. Once the whole view is silent it stops repainting.
+    - The spectrum is a dsp::FFT of the most recent samples, on a log frequency
+      scale, worked out at most once per frame and only while it's showing.
+
+    The component is opaque, so repainting it never repaints the window behind it.
+    It times its own work, and if that starts to take a noticeable share of the
+    message thread it skips screen refreshes, down to a quarter of the display's
+    frame rate, and speeds up again when there's room.
+
+    Click it to switch between the waveform and the spectrum.
+*/
+class AudioScope final : public Component
+{
+public:
+    AudioScope()
+    {
+        setOpaque (true);
+
+        for (auto& channel : channelBlocks)
+            channel.resize ((size_t) blockSize);
+
+        mixedBlock.resize ((size_t) blockSize);
+        spectrumHistory.resize ((size_t) fftSize);
+        fftData.resize ((size_t) (2 * fftSize));
+    }
+
+    //==============================================================================
+    /** Called on the audio thread with each block of output: this just copies it into the tap. */
+    void pushBlock (const float* const* channelData, int numChannels, int numSamples) noexcept
+    {
+        tap.push (channelData, numChannels, numSamples);
+    }
+
+    /** Can be called from any thread, e.g. when the device starts or stops. The scope
+        is cleared on the GUI thread at its next refresh.
+    */
+    void requestClear() noexcept
+    {
+        clearRequested.store (true, std::memory_order_release);
+    }
+
+    /** Can be called from any thread. The spectrum needs it to place each frequency. */
+    void setSampleRate (double newSampleRate) noexcept
+    {
+        if (newSampleRate > 0.0)
+            sampleRate.store (newSampleRate, std::memory_order_relaxed);
+    }
+
+    void setShowingSpectrum (bool shouldShowSpectrum)
+    {
+        if (showingSpectrum == shouldShowSpectrum)
+            return;
+
+        showingSpectrum = shouldShowSpectrum;
+        std::fill (spectrumLevels.begin(), spectrumLevels.end(), 0.0f);
+        samplesSinceSpectrum = 0;
+        repaint();
+    }
+
+    bool isShowingSpectrum() const noexcept         { return showingSpectrum; }
+
+    /** Returns how many screen refreshes each frame of the scope currently takes. */
+    int getFrameDivider() const noexcept            { return frameDivider; }
+
+    //==============================================================================
+    void paint (Graphics& g) override
+    {
+        const auto startTicks = Time::getHighResolutionTicks();
+
+        if (showingSpectrum)
+            paintSpectrum (g);
+        else
+            paintWaveform (g);
+
+        paintTicks += Time::getHighResolutionTicks() - startTicks;
+    }
+
+    void resized() override
+    {
+        const auto width = jmax (1, getWidth()), height = jmax (1, getHeight());
+
+        waveform = Image (Image::RGB, width, height, false);
+        waveform.clear (waveform.getBounds(), backgroundColour);
+        nextColumn = 0;
+        columnsSinceSignal = width;
+
+        spectrumLevels.assign ((size_t) width, 0.0f);
+    }
+
+    void mouseDown (const MouseEvent&) override
+    {
+        setShowingSpectrum (! showingSpectrum);
+    }
+
+private:
+    static constexpr int blockSize = 1024;
+    static constexpr int samplesPerColumn = 256;
+    static constexpr int fftOrder = 11, fftSize = 1 << fftOrder;
+    static constexpr int maxFrameDivider = 4;
+
+    // the boost that makes the waveform of a quiet synth easier to see
+    static constexpr float waveformGain = 10.0f;
+
+    //==============================================================================
+    void onVBlank()
+    {
+        const auto now = Time::getMillisecondCounterHiRes();
+
+        if (lastVBlankTime > 0.0)
+            vblankPeriod += 0.05 * (jlimit (1.0, 100.0, now - lastVBlankTime) - vblankPeriod);
+
+        lastVBlankTime = now;
+
+        if (clearRequested.exchange (false, std::memory_order_acquire))
+        {
+            tap.discardAll();
+            clearDisplay();
+        }
+
+        if (++vblanksSinceFrame < frameDivider)
+            return;
+
+        vblanksSinceFrame = 0;
+
+        const auto startTicks = Time::getHighResolutionTicks();
+        drainTap();
+        adaptFrameRate (Time::getHighResolutionTicks() - startTicks + std::exchange (paintTicks, 0));
+    }
+
+    void drainTap()
+    {
+        float* channels[] = { channelBlocks[0].data(), channelBlocks[1].data() };
+        auto* mixed = mixedBlock.data();
+        auto receivedAny = false;
+
+        for (;;)
+        {
+            const auto numSamples = tap.pop (channels, blockSize);
+
+            if (numSamples == 0)
+                break;
+
+            receivedAny = true;
+            FloatVectorOperations::add (mixed, channels[0], channels[1], numSamples);
+
+            if (showingSpectrum)
+                addToSpectrumHistory (mixed, numSamples);
+
+            FloatVectorOperations::multiply (mixed, waveformGain, numSamples);
+            addToWaveform (mixed, numSamples);
+        }
+
+        if (! receivedAny)
+            return;
+
+        if (showingSpectrum)
+        {
+            if (samplesSinceSpectrum >= fftSize / 4)
+            {
+                updateSpectrum();
+                repaint();
+            }
+        }
+        else if (columnsSinceSignal <= waveform.getWidth())
+        {
+            // once every column in view is flat, scrolling wouldn't change anything
+            repaint();
+        }
+    }
+
+    void clearDisplay()
+    {
+        if (waveform.isValid())
+            waveform.clear (waveform.getBounds(), backgroundColour);
+
+        nextColumn = 0;
+        columnSampleCount = 0;
+        columnsSinceSignal = waveform.getWidth();
+        std::fill (spectrumHistory.begin(), spectrumHistory.end(), 0.0f);
+        std::fill (spectrumLevels.begin(), spectrumLevels.end(), 0.0f);
+        repaint();
+    }
+
+    //==============================================================================
+    void addToWaveform (const float* data, int numSamples)
+    {
+        if (! waveform.isValid())
+            return;
+
+        std::optional<Graphics> g;
+
+        for (auto i = 0; i < numSamples;)
+        {
+            const auto num = jmin (numSamples - i, samplesPerColumn - columnSampleCount);
+            const auto range = FloatVectorOperations::findMinAndMax (data + i, num);
+
+            columnRange = columnSampleCount == 0 ? range : columnRange.getUnionWith (range);
+            columnSampleCount += num;
+            i += num;
+
+            if (columnSampleCount == samplesPerColumn)
+            {
+                if (! g.has_value())
+                    g.emplace (waveform);
+
+                drawColumn (*g, columnRange);
+                columnSampleCount = 0;
+            }
+        }
+    }
+
+    /** Draws one new column over the oldest one in the image. */
+    void drawColumn (Graphics& g, Range<float> range)
+    {
+        const auto height = (float) waveform.getHeight();
+        const auto centre = height * 0.5f;
+        const auto top    = jlimit (0.0f, height - 1.0f, centre - range.getEnd()   * centre);
+        const auto bottom = jlimit (0.0f, height - 1.0f, centre - range.getStart() * centre);
+
+        g.setColour (backgroundColour);
+        g.fillRect (nextColumn, 0, 1, waveform.getHeight());
+        g.setColour (waveformColour);
+        g.fillRect ((float) nextColumn, top, 1.0f, jmax (1.0f, bottom - top));
+
+        const auto isSilent = jmax (-range.getStart(), range.getEnd()) * centre < 0.5f;
+        columnsSinceSignal = isSilent ? columnsSinceSignal + 1 : 0;
+        nextColumn = (nextColumn + 1) % waveform.getWidth();
+    }
+
+    void paintWaveform (Graphics& g) const
+    {
+        if (! waveform.isValid())
+        {
+            g.fillAll (backgroundColour);
+            return;
+        }
+
+        // nextColumn is the oldest one, so it goes on the left
+        const auto width = waveform.getWidth(), height = waveform.getHeight();
+        const auto numOlder = width - nextColumn;
+
+        g.drawImage (waveform, 0, 0, numOlder, height, nextColumn, 0, numOlder, height);
+
+        if (nextColumn > 0)
+            g.drawImage (waveform, numOlder, 0, nextColumn, height, 0, 0, nextColumn, height);
+    }
+
+    //==============================================================================
+    void addToSpectrumHistory (const float* data, int numSamples) noexcept
+    {
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            spectrumHistory[(size_t) historyPosition] = data[i];
+            historyPosition = (historyPosition + 1) & (fftSize - 1);
+        }
+
+        samplesSinceSpectrum += numSamples;
+    }
+
+    void updateSpectrum()
+    {
+        samplesSinceSpectrum = 0;
+
+        for (auto i = 0; i < fftSize; ++i)
+            fftData[(size_t) i] = spectrumHistory[(size_t) ((historyPosition + i) & (fftSize - 1))];
+
+        window.multiplyWithWindowingTable (fftData.data(), (size_t) fftSize);
+        fft.performFrequencyOnlyForwardTransform (fftData.data(), true);
+
+        // a full-scale sine comes out of a Hann-windowed FFT at a quarter of its length
+        constexpr auto magnitudeScale = 4.0f / (float) fftSize;
+        constexpr auto minimumDecibels = -96.0f, minimumFrequency = 20.0;
+        constexpr auto decay = 0.85f;
+
+        const auto numColumns = (int) spectrumLevels.size();
+        const auto nyquist = sampleRate.load (std::memory_order_relaxed) * 0.5;
+        const auto binsPerHertz = (double) fftSize / (2.0 * nyquist);
+        const auto ratio = nyquist / minimumFrequency;
+
+        auto binAt = [&] (int column)
+        {
+            const auto frequency = minimumFrequency * std::pow (ratio, (double) column / (double) jmax (1, numColumns));
+            return jlimit (1, fftSize / 2, (int) (frequency * binsPerHertz));
+        };
+
+        auto startBin = binAt (0);
+
+        // each column shows the loudest bin it covers, or the nearest one where they're wider than the bins
+        for (auto column = 0; column < numColumns; ++column)
+        {
+            const auto nextBin = binAt (column + 1);
+            const auto endBin = jmax (startBin + 1, nextBin);
+            const auto magnitude = *std::max_element (fftData.begin() + startBin, fftData.begin() + endBin);
+            const auto level = jmap (jmax (minimumDecibels, Decibels::gainToDecibels (magnitude * magnitudeScale)),
+                                     minimumDecibels, 0.0f, 0.0f, 1.0f);
+
+            auto& shown = spectrumLevels[(size_t) column];
+            shown = jmax (level, shown * decay);
+            startBin = nextBin;
+        }
+    }
+
+    void paintSpectrum (Graphics& g)
+    {
+        g.fillAll (backgroundColour);
+
+        const auto height = (float) getHeight();
+
+        spectrumPath.clear();
+        spectrumPath.startNewSubPath (0.0f, height);
+
+        for (size_t column = 0; column < spectrumLevels.size(); ++column)
+            spectrumPath.lineTo ((float) column, height * (1.0f - spectrumLevels[column]));
+
+        spectrumPath.lineTo ((float) spectrumLevels.size(), height);
+        spectrumPath.closeSubPath();
+
+        g.setColour (waveformColour.withAlpha (0.8f));
+        g.fillPath (spectrumPath);
+    }
+
+    //==============================================================================
+    /** Skips screen refreshes while the scope's own drawing takes more than a small
+        share of the message thread, and stops skipping them once it's cheap again.
+    */
+    void adaptFrameRate (int64 frameTicks)
+    {
+        constexpr auto maximumShare = 0.1, comfortableShare = 0.04;
+
+        const auto frameTime = 1000.0 * (double) frameTicks / (double) Time::getHighResolutionTicksPerSecond();
+        frameCost += 0.2 * (frameTime - frameCost);
+
+        const auto share = frameCost / (vblankPeriod * frameDivider);
+
+        if (share > maximumShare && frameDivider < maxFrameDivider)
+            ++frameDivider;
+        else if (frameDivider > 1 && frameCost / (vblankPeriod * (frameDivider - 1)) < comfortableShare)
+            --frameDivider;
+    }
+
+    //==============================================================================
+    DisplayTap tap;
+    std::array<std::vector<float>, (size_t) DisplayTap::maxNumChannels> channelBlocks;
+    std::vector<float> mixedBlock;
+    std::atomic<bool> clearRequested { false };
+    std::atomic<double> sampleRate { 44100.0 };
+
+    Colour backgroundColour { Colours::black }, waveformColour { Colours::white };
+
+    Image waveform;
+    int nextColumn = 0, columnSampleCount = 0, columnsSinceSignal = 0;
+    Range<float> columnRange;
+
+    bool showingSpectrum = false;
+    dsp::FFT fft { fftOrder };
+    dsp::WindowingFunction<float> window { (size_t) fftSize, dsp::WindowingFunction<float>::hann, false };
+    std::vector<float> spectrumHistory, fftData, spectrumLevels;
+    int historyPosition = 0, samplesSinceSpectrum = 0;
+    Path spectrumPath;
+
+    int frameDivider = 1, vblanksSinceFrame = 0;
+    double lastVBlankTime = 0.0, vblankPeriod = 1000.0 / 60.0, frameCost = 0.0;
+    int64 paintTicks = 0;
+
+    VBlankAttachment vBlankAttachment { this, [this] { onVBlank(); } };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioScope)
+};
@@ -53,7 +53,20 @@
 #pragma once
 
 #include "DemoUtilities.h"
-#include "AudioLiveScrollingDisplay.h"
+#include "AudioScope.h"
+#include "WavetableBank.h"
+#include "OscillatorKernels.h"
+#include "BlockEnvelope.h"
+#include "SynthParameters.h"
+#include "ScratchArena.h"
+#include "RealtimeAllocationDetector.h"
+#include "PolySynthesiser.h"
+#include "CachedSampler.h"
+#include "VoiceFilterBank.h"
+#include "Oversampler.h"
+#include "MidiInputFifo.h"
+#include "MidiTraceRecorder.h"
+#include "PerformanceMonitor.h"
 
 //==============================================================================
 /** Our demo synth sound is just a basic sine wave.. */
@@ -64,20 +77,16 @@ struct SineWaveSound final : public SynthesiserSound
 };
 
 //==============================================================================
-/** Our demo synth voice just plays a sine wave.. */
-class SineWaveVoice : public juce::SynthesiserVoice
+/** Our demo synth voice plays one of the band-limited waveforms in a shared WavetableBank.. */
+class SineWaveVoice : public PolySynthesiserVoice
 {
 public:
     enum WaveType { Sine, Square, Sawtooth, Triangle };
+    static_assert ((int) Triangle == (int) WavetableBank::triangle, "WaveType must match the WavetableBank waveforms");
+
     SineWaveVoice()
-        : currentAngle(0.0), angleDelta(0.0), level(0.0), tailOff(0.0)
+        : level(0.0), tailOff(0.0)
     {
-        // Initialize ADSR parameters when the object is created
-        adsrParams.attack = 0.5f;
-        adsrParams.decay = 0.1f;
-        adsrParams.sustain = 0.9f;
-        adsrParams.release = 0.9f;
-        adsr.setParameters(adsrParams);
     }
 
     ~SineWaveVoice() override {}
@@ -87,37 +96,11 @@ public:
     {
         return dynamic_cast<SineWaveSound*> (sound) != nullptr;
     }
-    void setAttack(float attack)
-      {
-          adsrParams.attack = attack;
-        adsr.setParameters(adsrParams);
-        
-      }
-
-      void setDecay(float decay)
-      {
-          adsrParams.decay = decay;
-          adsr.setParameters(adsrParams);
-          
-      }
-
-      void setSustain(float sustain)
-      {
-          adsrParams.sustain = sustain;
-          adsr.setParameters(adsrParams);
-
-      }
 
-      void setRelease(float release)
-      {
-          adsrParams.release = release;
-          adsr.setParameters(adsrParams);
-
-      }
     void startNote (int midiNoteNumber, float velocity,
                     SynthesiserSound*, int /*currentPitchWheelPosition*/) override
     {
-        currentAngle = 0.0;
+        currentPhase = 0.0f;
         level = velocity * 0.15;
         tailOff = 0.0;
 
@@ -125,95 +108,175 @@ public:
             envelopeValue = 0.0f; // Reset envelope value
             currentAmplitude = 0.0f; // Reset current amplitude
 
+        // the note's own frequency is only worked out here; bends and vibrato scale it
         auto cyclesPerSecond = MidiMessage::getMidiNoteInHertz (midiNoteNumber);
-        auto cyclesPerSample = cyclesPerSecond / getSampleRate();
+        cyclesPerSample = cyclesPerSecond / getSampleRate();
+        phaseDelta = (float) cyclesPerSample;
 
-        angleDelta = cyclesPerSample * MathConstants<double>::twoPi;
-        adsr.noteOn(); // Start the ADSR envelope
+        applyParameters();
+        modulator.startNote (getChannelState(), modulation, getSampleRate());
+        envelope.noteOn(); // Start the ADSR envelope
     }
 
     void stopNote (float /*velocity*/, bool allowTailOff) override
     {
         if (allowTailOff)
          {
-             adsr.noteOff(); // Start the release phase
+             envelope.noteOff(); // Start the release phase
          }
          else
          {
              clearCurrentNote();
-             //adsr.reset(); // Reset the ADSR envelope
+             envelope.reset(); // Reset the ADSR envelope
          }
+
+        modulator.stopNote (allowTailOff);
     }
 
     
 
+    // the modulator reads the channel's pitch wheel and controllers as it renders
     void pitchWheelMoved (int /*newValue*/) override                              {}
     void controllerMoved (int /*controllerNumber*/, int /*newValue*/) override    {}
 
     void renderNextBlock (AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override
     {
-        
-        if (!adsr.isActive()) // Stop rendering if the envelope is inactive
+        applyParameters();
+
+        if (!envelope.isActive()) // Stop rendering if the envelope is inactive
         {
             clearCurrentNote();
             return;
         }
-        if (!approximatelyEqual(angleDelta, 0.0))
+        if (wavetables == nullptr || scratch == nullptr || phaseDelta <= 0.0f)
+            return;
+
+        auto gain = (float) level;
+
+        while (numSamples > 0)
         {
-            while (--numSamples >= 0)
+            auto numThisTime = jmin (numSamples, scratchSize);
+
+            // the envelope advances exactly once per sample, and is applied before the
+            // block is mixed, so every channel gets it from this one multiply
+            envelope.fillGainCurve (envelopeCurve, numThisTime);
+
+            for (auto offset = 0; offset < numThisTime;)
             {
-                float currentSample = 0.0f;
+                const auto numInStep = jmin (numThisTime - offset, VoiceModulator::controlInterval);
+                const auto ramp = modulator.advance (getChannelState(), modulation, numInStep);
 
-                switch (currentWaveType)
-                {
-                    case Sine:
-                        currentSample = (float) (std::sin(currentAngle) * level);
-                        break;
-                    case Square:
-                        currentSample = (float) (std::sin(currentAngle) >= 0 ? level : -level);
-                        break;
-                    case Sawtooth:
-                        currentSample = (float) ((2.0 * (currentAngle / MathConstants<double>::twoPi) - 1.0) * level);
-                        break;
-                    case Triangle:
-                        currentSample = (float) (2.0 * (currentAngle / MathConstants<double>::twoPi) - 1.0);
-                        currentSample = (currentSample < 0) ? -currentSample : currentSample; // Absolute value for triangle
-                        currentSample *= level; // Scale by level
-                        break;
-                }
+                // the pitch glides from one control value to the next, and the table is
+                // picked for the higher end of the glide so that it never aliases
+                const auto startDelta = jlimit (0.0f, 0.5f, phaseDelta * ramp.pitchStart);
+                const auto endDelta   = jlimit (0.0f, 0.5f, phaseDelta * ramp.pitchEnd);
+                auto* table = wavetables->getTable (currentWaveType, jmax (startDelta, endDelta));
 
-                for (auto i = outputBuffer.getNumChannels(); --i >= 0;)
-                {
-                    adsr.applyEnvelopeToBuffer(outputBuffer, startSample, adsr.getNextSample() * currentSample);
-                    outputBuffer.addSample(i, startSample, adsr.getNextSample() * currentSample);
-                    
-                }
+                OscillatorKernels::renderWavetable (table, scratch + offset, numInStep, currentPhase,
+                                                    startDelta, (endDelta - startDelta) / (float) numInStep);
+                VoiceModulator::multiplyByRamp (envelopeCurve + offset, ramp.levelStart, ramp.levelEnd, numInStep);
+
+                if (filterBank != nullptr)
+                    filterBank->setCutoffScale (filterSlot, startSample + offset, numInStep, ramp.cutoffEnd);
 
-                currentAngle += angleDelta;
-                if (currentAngle >= MathConstants<float>::twoPi)
-                    currentAngle -= MathConstants<float>::twoPi;
-              //  adsr.applyEnvelopeToBuffer(outputBuffer, startSample, numSamples);
-                ++startSample;
+                offset += numInStep;
+            }
+
+            FloatVectorOperations::multiply (scratch, envelopeCurve, numThisTime);
+
+            if (filterBank != nullptr)
+            {
+                filterBank->addInput (filterSlot, startSample, scratch, gain, numThisTime);
+            }
+            else
+            {
+                for (auto i = outputBuffer.getNumChannels(); --i >= 0;)
+                    FloatVectorOperations::addWithMultiply (outputBuffer.getWritePointer (i, startSample),
+                                                            scratch, gain, numThisTime);
             }
-          
-        }
 
+            startSample += numThisTime;
+            numSamples  -= numThisTime;
+        }
     }
 
     using SynthesiserVoice::renderNextBlock;
-    void setWaveType(WaveType newType)
+
+    float getCurrentLevel() const noexcept override
     {
-        currentWaveType = newType;
+        return (float) level * envelope.getCurrentLevel() * modulator.getCurrentLevel();
     }
-    
+
     void setADSRSampleRate(double sampleRate){
-        adsr.setSampleRate (sampleRate);
+        envelope.setSampleRate (sampleRate);
+    }
+
+    /** Sets the store the voice reads its settings from. The voice only ever reads the
+        audio thread's snapshot, so nothing the GUI does can change them mid-block.
+    */
+    void setParameterStore (const SynthParameterStore* newParameters)
+    {
+        parameters = newParameters;
+    }
+
+    /** Sets the shared tables this voice reads from. They must outlive the voice's use of them. */
+    void setWavetables (const WavetableBank* newWavetables)
+    {
+        wavetables = newWavetables;
+    }
+
+    /** Sends the voice through its own filter, in a slot of a bank, instead of mixing
+        it straight into the output.
+    */
+    void setFilterBank (VoiceFilterBank* newFilterBank, int slot) noexcept
+    {
+        filterBank = newFilterBank;
+        filterSlot = slot;
+    }
+
+    /** Returns how much of a ScratchArena prepareScratch() will use. */
+    static size_t getScratchSizeNeeded (int maximumBlockSize) noexcept
+    {
+        return 2 * ScratchArena::getAllocationSize ((size_t) maximumBlockSize);
+    }
+
+    /** Takes the blocks the voice renders into before mixing from an arena. Longer
+        blocks are rendered in several chunks, so the voice never needs to allocate.
+    */
+    void prepareScratch (ScratchArena& arena, int maximumBlockSize)
+    {
+        scratch       = arena.allocate ((size_t) maximumBlockSize);
+        envelopeCurve = arena.allocate ((size_t) maximumBlockSize);
+        scratchSize   = scratch != nullptr && envelopeCurve != nullptr ? maximumBlockSize : 0;
     }
 private:
-    double currentAngle = 0.0, angleDelta = 0.0, level = 0.0, tailOff = 0.0;
+    void applyParameters()
+    {
+        if (parameters == nullptr)
+            return;
+
+        const auto& snapshot = parameters->getSnapshot();
+        envelope.setParameters (snapshot.envelope);
+        envelope.setCurve (snapshot.envelopeCurve);
+        currentWaveType = (WaveType) snapshot.waveform;
+        modulation = snapshot.modulation;
+    }
+
+    double level = 0.0, tailOff = 0.0;
+    double cyclesPerSample = 0.0;
+    float currentPhase = 0.0f, phaseDelta = 0.0f; // in cycles, so the phase wraps at 1.0
+
+    const WavetableBank* wavetables = nullptr;
+    VoiceFilterBank* filterBank = nullptr;
+    int filterSlot = 0;
+    float* scratch = nullptr;          // these point into the SynthAudioSource's ScratchArena
+    float* envelopeCurve = nullptr;
+    int scratchSize = 0;
   
-    juce::ADSR adsr;
-    juce::ADSR::Parameters adsrParams;
+    const SynthParameterStore* parameters = nullptr;
+    BlockEnvelope envelope;
+    VoiceModulator modulator;
+    ModulationParameters modulation;
     WaveType currentWaveType = Sine;
     float attackTime = 0.1f; // in seconds
        float decayTime = 0.1f;  // in seconds
@@ -229,97 +292,278 @@ private:
 // This is an audio source that streams the output of our demo synth.
 struct SynthAudioSource final : public AudioSource
 {
-    SynthAudioSource (MidiKeyboardState& keyState)  : keyboardState (keyState)
+    static constexpr int minNumVoices = 8, maxNumVoices = 512;
+
+    SynthAudioSource (MidiKeyboardState& keyState, int numVoicesPerSound = 16)  : keyboardState (keyState)
     {
-        // Add some voices to our synth, to play the sounds..
-        for (auto i = 0; i < 4; ++i)
+        // the voices themselves are created by prepareToPlay()
+        setNumVoices (numVoicesPerSound);
+
+        // ..and add the sounds for them to play. Both stay in the synth for good, and
+        // switching between them just changes which one new notes are given to
+        synth.addSound (sineWaveSound.get());
+        synth.addSound (sampledSound.get());
+        setUsingSineWaveSound();
+    }
+
+    /** Changes some of the synth's parameters. Call this from the message thread; the
+        audio thread picks up the new values at the start of its next block.
+    */
+    template <typename Function>
+    void updateParameters (Function&& change)
+    {
+        parameters.update (std::forward<Function> (change));
+    }
+
+    /** Spreads the voices across this many extra realtime threads, or renders them all
+        on the audio thread if numThreads is 0. Call this from the message thread.
+
+        The workers spin while they wait for work, so there's never more of them than
+        there are spare CPUs.
+    */
+    void setNumRenderThreads (int numThreads)
+    {
+        numThreads = jmin (numThreads, SystemStats::getNumCpus() - 1);
+        std::unique_ptr<VoiceRenderPool> newPool;
+
+        if (numThreads > 0)
         {
-            synth.addVoice (new SineWaveVoice());   // These voices will play our custom sine-wave sounds..
-            synth.addVoice (new SamplerVoice());    // and these ones play the sampled sounds
+            newPool = std::make_unique<VoiceRenderPool> (numThreads);
+
+            if (currentSampleRate > 0.0)
+                newPool->prepare (numOutputChannels, maximumBlockSize * oversamplingFactor, currentSampleRate * oversamplingFactor);
         }
 
-        // ..and add a sound for them to play...
-        setUsingSineWaveSound();
-        filter.state = *dsp::IIR::Coefficients<float>::makeLowPass(44100, 1000.0f, 0.7f);
+        synth.setVoiceRenderPool (newPool.get());
+
+        // the synth has let go of the old pool, so its threads can be stopped now
+        std::swap (renderPool, newPool);
     }
 
-    void setVolume(float newVolume)
+    int getNumRenderThreads() const noexcept
     {
-        volume = newVolume;
+        return renderPool != nullptr ? renderPool->getNumWorkerThreads() : 0;
+    }
+
+    /** Sets how many voices each sound can play at once, between minNumVoices and
+        maxNumVoices. The voices are allocated by prepareToPlay(), so the new number
+        takes effect the next time that's called.
+    */
+    void setNumVoices (int newNumVoices)
+    {
+        numVoicesRequested = jlimit (minNumVoices, maxNumVoices, newNumVoices);
+    }
+
+    int getNumVoices() const noexcept       { return numVoicesRequested; }
+
+    /** Sets how many times the device rate the voices and their filters run at: 1, 2,
+        4 or 8. Like the number of voices, this takes effect the next time
+        prepareToPlay() is called.
+    */
+    void setOversamplingFactor (int newFactor)
+    {
+        jassert (newFactor == 1 || newFactor == 2 || newFactor == 4 || newFactor == 8);
+        oversamplingFactorRequested = jlimit (1, Oversampler::maxFactor, nextPowerOfTwo (newFactor));
+    }
+
+    int getOversamplingFactor() const noexcept  { return oversamplingFactorRequested; }
+
+    /** Returns how far the output lags behind the MIDI that produced it, in samples at
+        the device rate, which is the oversampler's delay, rounded to the nearest sample.
+    */
+    int getLatencyInSamples() const noexcept    { return roundToInt (oversampler.getLatencyInSamples()); }
+
+    void setVolume (float newVolume)
+    {
+        updateParameters ([newVolume] (SynthParameters& p) { p.volume = newVolume; });
     }
     void setUsingSineWaveSound()
     {
-        synth.clearSounds();
-        synth.addSound (new SineWaveSound());
+        updateParameters ([] (SynthParameters& p) { p.useSampledSound = false; });
     }
 
+    /** Switches to the sampled cello. The sample is only decoded the first time it's
+        used at each sample rate; after that, switching to it is instant.
+    */
     void setUsingSampledSound()
     {
-        WavAudioFormat wavFormat;
+        sampledSoundRequested = true;
+
+        // if the rate isn't known yet, prepareToPlay() will load the sample instead
+        if (const auto sampleRate = currentSampleRate.load(); sampleRate > 0.0 && ! loadSampledSound (sampleRate))
+            return;
 
-        std::unique_ptr<AudioFormatReader> audioReader (wavFormat.createReaderFor (createAssetInputStream ("cello.wav").release(), true));
+        updateParameters ([] (SynthParameters& p) { p.useSampledSound = true; });
+    }
 
-        BigInteger allNotes;
-        allNotes.setRange (0, 128, true);
+    /** Switches to a sample streamed from a WAV or AIFF file, which plays at its own
+        pitch at the root note. Only the start of the file is loaded; the rest is read
+        from disk as notes play it. Returns false if the file can't be streamed.
+    */
+    bool setUsingStreamedSample (const File& file, int rootNote)
+    {
+        auto* sample = sampleCache.getStreamedSample (file);
 
-        synth.clearSounds();
-        synth.addSound (new SamplerSound ("demo sound",
-                                          *audioReader,
-                                          allNotes,
-                                          74,   // root midi note
-                                          0.1,  // attack time
-                                          0.1,  // release time
-                                          10.0  // maximum sample length
-                                          ));
+        if (sample == nullptr)
+            return false;
+
+        sampledSoundRequested = false;  // so that prepareToPlay() doesn't load the cello over it
+        sampledSound->setSample (sample, rootNote);
+        updateParameters ([] (SynthParameters& p) { p.useSampledSound = true; });
+        return true;
     }
 
-    void prepareToPlay (int /*samplesPerBlockExpected*/, double sampleRate) override
+    /** Switches to a multisampled instrument described by a manifest file; see
+        MultisampleInstrument for the format. Loading an instrument reads the start of
+        every one of its samples, so call this from the message thread.
+    */
+    Result setUsingInstrument (const File& manifest)
     {
-        midiCollector.reset (sampleRate);
+        auto instrument = std::make_unique<MultisampleInstrument>();
 
-        synth.setCurrentPlaybackSampleRate (sampleRate);
-        dsp::ProcessSpec spec;
-                spec.sampleRate = sampleRate;
-                spec.maximumBlockSize = 512;
-                spec.numChannels = 2;
-                filter.prepare(spec);
-        
-        for (int i = 0; i < synth.getNumVoices(); ++i)
-                {
-                    auto* voice = synth.getVoice(i);
+        if (auto result = instrument->loadFromManifest (manifest, sampleCache); result.failed())
+            return result;
 
-                    if (auto* sineWaveVoice = dynamic_cast<SineWaveVoice*>(voice))
-                    {
-                        sineWaveVoice->setADSRSampleRate(sampleRate);  // Set the sample rate for each voice
-                    }
-                }
-       //  synth.getVoice(0)->setADSRSampleRate(sampleRate);
+        // instruments are kept until the source is deleted, like the samples in the
+        // cache, so a voice that's still playing one never has to be waited for
+        sampledSoundRequested = false;
+        sampledSound->setInstrument (instruments.add (std::move (instrument)));
+        updateParameters ([] (SynthParameters& p) { p.useSampledSound = true; });
+        return Result::ok();
+    }
+
+    /** Sets how carefully the sampler voices pitch their samples. Notes that are
+        already playing keep the quality they started with.
+    */
+    void setResamplingQuality (ResamplingQuality newQuality)
+    {
+        updateParameters ([newQuality] (SynthParameters& p) { p.resamplingQuality = newQuality; });
+    }
+
+    /** When rendering offline, the voices can wait for streamed samples to be read
+        from disk instead of dropping out.
+    */
+    void setNonRealtime (bool isNonRealtime) noexcept    { sampleStreamer.setNonRealtime (isNonRealtime); }
+
+    /** Returns how many times a voice has run out of streamed sample data. */
+    int getNumStreamUnderruns() const noexcept          { return sampleStreamer.getNumUnderruns(); }
+
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        midiInputFifo.prepare (sampleRate);
+
+        // the tables don't depend on the sample rate, so this only does any work the first time
+        wavetables.build();
+        resampler.build();
+
+        maximumBlockSize = jmax (samplesPerBlockExpected, 512);
+
+        // the voices and their filters run at the oversampled rate, and everything
+        // after the oversampler at the device rate
+        oversamplingFactor = oversamplingFactorRequested;
+        const auto renderSampleRate = sampleRate * oversamplingFactor;
+        const auto renderBlockSize = maximumBlockSize * oversamplingFactor;
+
+        synth.setCurrentPlaybackSampleRate (renderSampleRate);
+        oversampler.prepare (oversamplingFactor, numOutputChannels, maximumBlockSize);
+        oversampledBuffer.setSize (numOutputChannels, renderBlockSize);
+        oversampledMidi.ensureSize (midiBufferSize);
+
+        createVoices (numVoicesRequested);
+
+        if (sampledSoundRequested)
+            loadSampledSound (sampleRate);
+
+        // everything the callback needs is allocated here, so that it never has to
+        scratchArena.prepare ((size_t) sineWaveVoices.size() * SineWaveVoice::getScratchSizeNeeded (renderBlockSize)
+                                + (size_t) samplerVoices.size() * CachedSamplerVoice::getScratchSizeNeeded (renderBlockSize)
+                                + ScratchArena::getAllocationSize ((size_t) maximumBlockSize));
+
+        for (auto* sineWaveVoice : sineWaveVoices)
+        {
+            sineWaveVoice->setADSRSampleRate(renderSampleRate);  // Set the sample rate for each voice
+            sineWaveVoice->setWavetables (&wavetables);
+            sineWaveVoice->prepareScratch (scratchArena, renderBlockSize);
+        }
+
+        // every sine voice has one filter, which goes to all channels, and every
+        // sampler voice has a left and a right one after them
+        voiceFilters.prepare (sineWaveVoices.size() + 2 * samplerVoices.size(), renderBlockSize, renderSampleRate);
+
+        for (auto i = 0; i < sineWaveVoices.size(); ++i)
+            sineWaveVoices[i]->setFilterBank (&voiceFilters, i);
+
+        for (auto i = 0; i < samplerVoices.size(); ++i)
+        {
+            const auto firstSlot = sineWaveVoices.size() + 2 * i;
+            samplerVoices[i]->setFilterBank (&voiceFilters, firstSlot);
+            voiceFilters.setRouting (firstSlot, 0);
+            voiceFilters.setRouting (firstSlot + 1, 1);
+        }
+
+        // so the render pool can skip its sub-mixes
+        synth.setVoicesMixIntoOutput (false);
+
+        sampleStreamer.prepare (samplerVoices.size());
+
+        for (auto i = 0; i < samplerVoices.size(); ++i)
+        {
+            samplerVoices[i]->setResampler (&resampler);
+            samplerVoices[i]->setParameterStore (&parameters);
+            samplerVoices[i]->prepareScratch (scratchArena, renderBlockSize);
+            samplerVoices[i]->prepareStream (sampleStreamer, i);
+        }
+
+        gainRamp = scratchArena.allocate ((size_t) maximumBlockSize);
+
+        currentSampleRate = sampleRate;
+
+        if (renderPool != nullptr)
+            renderPool->prepare (numOutputChannels, renderBlockSize, renderSampleRate);
+
+        incomingMidi.ensureSize (midiBufferSize);
+        synth.prepareEventScheduler (maxMidiEventsPerBlock);
+
+        // the audio callback isn't running yet, so it's safe to pick up the parameters here
+        parameters.pull();
+        const auto& snapshot = parameters.getSnapshot();
+        setActiveSound (snapshot);
+        volume.reset (sampleRate, 0.05);
+        volume.setCurrentAndTargetValue (snapshot.volume);
+
+        // these are read by the voices' filters, at the rate they run at
+        cutoff.reset (renderSampleRate, 0.05);
+        cutoff.setCurrentAndTargetValue (snapshot.cutoff);
+        resonance.reset (renderSampleRate, 0.05);
+        resonance.setCurrentAndTargetValue (snapshot.resonance);
     }
 
     void releaseResources() override {}
 
     void getNextAudioBlock (const AudioSourceChannelInfo& bufferToFill) override
     {
+        RealtimeAllocationDetector::ScopedRealtimeSection realtimeSection;
+
         // the synth always adds its output to the audio buffer, so we have to clear it
         // first..
         bufferToFill.clearActiveBufferRegion();
 
-        // fill a midi buffer with incoming messages from the midi input.
-        MidiBuffer incomingMidi;
-        midiCollector.removeNextBlockOfMessages (incomingMidi, bufferToFill.numSamples);
-
-        // pass these messages to the keyboard state so that it can update the component
-        // to show on-screen which keys are being pressed on the physical midi keyboard.
-        // This call will also add midi messages to the buffer which were generated by
-        // the mouse-clicking on the on-screen keyboard.
-        keyboardState.processNextMidiBuffer (incomingMidi, 0, bufferToFill.numSamples, true);
-
-        // and now get the synth to process the midi events and generate its output.
-        synth.renderNextBlock (*bufferToFill.buffer, incomingMidi, 0, bufferToFill.numSamples);
-        dsp::AudioBlock<float> block (*bufferToFill.buffer);
-               dsp::ProcessContextReplacing<float> context (block);
-               filter.process(context);
-        
+        {
+            PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::midiInput);
+
+            // fill a midi buffer with incoming messages from the midi input. Clearing it
+            // keeps its storage, so it only grows if a block has more events than ever before
+            incomingMidi.clear();
+            midiInputFifo.removeNextBlockOfMessages (incomingMidi, bufferToFill.numSamples);
+
+            // pass these messages to the keyboard state so that it can update the component
+            // to show on-screen which keys are being pressed on the physical midi keyboard.
+            // This call will also add midi messages to the buffer which were generated by
+            // the mouse-clicking on the on-screen keyboard.
+            keyboardState.processNextMidiBuffer (incomingMidi, 0, bufferToFill.numSamples, true);
+        }
+
+        renderNextBlock (*bufferToFill.buffer, incomingMidi, 0, bufferToFill.numSamples);
      //   float rmsLevel = bufferToFill.buffer->getRMSLevel(0, 0, bufferToFill.numSamples);
       //  float gainCompensation = calculateGainCompensation(rmsLevel);
        // smoothedGainCompensation += 0.1f * (gainCompensation - smoothedGainCompensation);
@@ -349,34 +593,303 @@ struct SynthAudioSource final : public AudioSource
     }
 
 */
-    void updateFilterCoefficients(double frequency, double resonance)
+    /** Sets the cutoff and Q of the voices' filters. Call this from the message thread;
+        the audio thread glides to the new values over the next few blocks.
+    */
+    void updateFilterCoefficients (double frequency, double q)
+    {
+        updateParameters ([frequency, q] (SynthParameters& p)
+        {
+            p.cutoff = (float) frequency;
+            p.resonance = (float) q;
+        });
+    }
+
+    /** Renders the synth and its filters into a buffer that has already been cleared.
+
+        This is the part of getNextAudioBlock() that doesn't depend on a live device,
+        so it can also be driven directly, e.g. by the offline renderer.
+    */
+    void renderNextBlock (AudioBuffer<float>& buffer, const MidiBuffer& midi, int startSample, int numSamples)
+    {
+        RealtimeAllocationDetector::ScopedRealtimeSection realtimeSection;
+
+        // pick up any parameter changes once, before anything in this block reads them
+        if (parameters.pull())
+        {
+            const auto& snapshot = parameters.getSnapshot();
+            setActiveSound (snapshot);
+            volume.setTargetValue (snapshot.volume);
+            cutoff.setTargetValue (snapshot.cutoff);
+            resonance.setTargetValue (snapshot.resonance);
+        }
+
+        const auto& snapshot = parameters.getSnapshot();
+
+        // the voices' filters hold at most one maximum-sized block, so a longer block
+        // is rendered in pieces; the synth picks out each piece's midi events itself
+        for (auto position = startSample; position < startSample + numSamples;)
+        {
+            const auto numThisTime = jmin (maximumBlockSize, startSample + numSamples - position);
+
+            // get the synth to process the midi events and generate its output, which
+            // each voice sends through its own filter
+            if (oversamplingFactor == 1)
+            {
+                {
+                    PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::voices);
+                    voiceFilters.beginBlock (position, numThisTime);
+                    synth.renderNextBlock (buffer, midi, position, numThisTime);
+                }
+
+                PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::filters);
+                voiceFilters.endBlock (buffer, snapshot.filterType, snapshot.filterDrive, cutoff, resonance);
+            }
+            else
+            {
+                renderOversampled (buffer, midi, position, numThisTime, snapshot);
+            }
+
+            position += numThisTime;
+        }
+
+        {
+            PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::volume);
+            applyVolume (buffer, startSample, numSamples);
+        }
+
+        if (performance.isMeasuring())
+            performance.setNumActiveVoices (getNumActiveVoices());
+    }
+
+    void setFilterType (FilterType newType)
+    {
+        updateParameters ([newType] (SynthParameters& p) { p.filterType = newType; });
+    }
+
+    /** Sets how hard the voices drive their filters; 1 is clean. Driven filters are the
+        main thing oversampling is for.
+    */
+    void setFilterDrive (float newDrive)
+    {
+        updateParameters ([newDrive] (SynthParameters& p) { p.filterDrive = jmax (1.0f, newDrive); });
+    }
+
+    void setWaveType (SineWaveVoice::WaveType newType)
+    {
+        updateParameters ([newType] (SynthParameters& p) { p.waveform = (WavetableBank::Waveform) newType; });
+    }
+
+    void setEnvelopeCurve (BlockEnvelope::Curve newCurve)
+    {
+        updateParameters ([newCurve] (SynthParameters& p) { p.envelopeCurve = newCurve; });
+    }
+
+    void setEnvelopeParameters (const ADSR::Parameters& newParams)
+    {
+        updateParameters ([newParams] (SynthParameters& p) { p.envelope = newParams; });
+    }
+
+    /** Sets how far pitch bend, the mod wheel, the brightness controller and the
+        filter envelope move the sound, and the rate of the voices' LFOs.
+    */
+    void setModulationParameters (const ModulationParameters& newParams)
     {
-        *filter.state = *dsp::IIR::Coefficients<float>::makeLowPass(synth.getSampleRate(), frequency, resonance);
+        updateParameters ([newParams] (SynthParameters& p) { p.modulation = newParams; });
     }
+
+    int getNumActiveVoices() const
+    {
+        auto numActive = 0;
+
+        for (auto i = 0; i < synth.getNumVoices(); ++i)
+            if (synth.getVoice (i)->isVoiceActive())
+                ++numActive;
+
+        return numActive;
+    }
+private:
+    void createVoices (int numVoicesPerSound)
+    {
+        if (sineWaveVoices.size() == numVoicesPerSound)
+            return;
+
+        synth.clearVoices();
+        sineWaveVoices.clearQuick();
+        samplerVoices.clearQuick();
+
+        for (auto i = 0; i < numVoicesPerSound; ++i)
+        {
+            auto* sineWaveVoice = new SineWaveVoice();
+            sineWaveVoice->setParameterStore (&parameters);
+            sineWaveVoices.add (sineWaveVoice);
+
+            synth.addVoice (sineWaveVoice);         // These voices will play our custom sine-wave sounds..
+            auto* samplerVoice = new CachedSamplerVoice();
+            samplerVoices.add (samplerVoice);
+            synth.addVoice (samplerVoice);          // and these ones play the sampled sounds
+        }
+
+        synth.prepareVoiceList();
+    }
+
+    bool loadSampledSound (double sampleRate)
+    {
+        auto* sample = sampleCache.getSample ("cello.wav", sampleRate);
+
+        if (sample == nullptr)
+            return false;
+
+        sampledSound->setSample (sample, 74);   // the cello plays at its own pitch at note 74
+        return true;
+    }
+
+    void setActiveSound (const SynthParameters& snapshot) noexcept
+    {
+        synth.setActiveSound (snapshot.useSampledSound ? static_cast<SynthesiserSound*> (sampledSound.get())
+                                                       : static_cast<SynthesiserSound*> (sineWaveSound.get()));
+    }
+
+    /** Renders the voices at the oversampled rate, with the events' positions scaled
+        to match, and decimates the result into the buffer.
+    */
+    void renderOversampled (AudioBuffer<float>& buffer, const MidiBuffer& midi, int startSample, int numSamples,
+                            const SynthParameters& snapshot)
+    {
+        const auto numOversampled = numSamples * oversamplingFactor;
+
+        {
+            PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::voices);
+            oversampledMidi.clear();
+
+            for (const auto metadata : midi.findNextSamplePosition (startSample))
+            {
+                if (metadata.samplePosition >= startSample + numSamples)
+                    break;
+
+                oversampledMidi.addEvent (metadata.data, metadata.numBytes, (metadata.samplePosition - startSample) * oversamplingFactor);
+            }
+
+            oversampledBuffer.clear (0, numOversampled);
+
+            voiceFilters.beginBlock (0, numOversampled);
+            synth.renderNextBlock (oversampledBuffer, oversampledMidi, 0, numOversampled);
+        }
+
+        {
+            PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::filters);
+            voiceFilters.endBlock (oversampledBuffer, snapshot.filterType, snapshot.filterDrive, cutoff, resonance);
+        }
+
+        PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::oversampling);
+        oversampler.processDown (oversampledBuffer, buffer, startSample, numSamples);
+    }
+
+    void applyVolume (AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        if (! volume.isSmoothing())
+        {
+            buffer.applyGain (startSample, numSamples, volume.getTargetValue());
+            return;
+        }
+
+        if (gainRamp == nullptr)
+            return;
+
+        while (numSamples > 0)
+        {
+            auto numThisTime = jmin (numSamples, maximumBlockSize);
+
+            for (auto i = 0; i < numThisTime; ++i)
+                gainRamp[i] = volume.getNextValue();
+
+            for (auto channel = buffer.getNumChannels(); --channel >= 0;)
+                FloatVectorOperations::multiply (buffer.getWritePointer (channel, startSample), gainRamp, numThisTime);
+
+            startSample += numThisTime;
+            numSamples  -= numThisTime;
+        }
+    }
+
+public:
     //==============================================================================
-    // this collects real-time midi messages from the midi input device, and
-    // turns them into blocks that we can process in our audio callback
-    MidiMessageCollector midiCollector;
+    // this queues real-time midi messages from the midi input device without locking,
+    // and turns them into blocks that we can process in our audio callback
+    MidiInputFifo midiInputFifo;
+
+    // times the audio callback's stages; the Callback starts and finishes each block
+    PerformanceMonitor performance;
+
+    // the callback's midi events go here; it's reused every block so it never allocates
+    MidiBuffer incomingMidi;
+    static constexpr size_t midiBufferSize = 16384; // in bytes, which is about 1800 short messages
+    static constexpr int maxMidiEventsPerBlock = 2048;
 
     // this represents the state of which keys on our on-screen keyboard are held
     // down. When the mouse is clicked on the keyboard component, this object also
     // generates midi messages for this, which we can pass on to our synth.
     MidiKeyboardState& keyboardState;
 
+    // the band-limited oscillator tables shared by all the SineWaveVoices
+    WavetableBank wavetables;
+
+    // the sinc kernels shared by all the CachedSamplerVoices
+    SincResampler resampler;
+
+    // the parameters set by the GUI, and the snapshot of them the audio thread is using
+    SynthParameterStore parameters;
+
+    // the decoded samples; this has to outlive the synth, whose voices point into it
+    SampleCache sampleCache;
+    ReferenceCountedObjectPtr<SineWaveSound> sineWaveSound { new SineWaveSound() };
+    ReferenceCountedObjectPtr<CachedSamplerSound> sampledSound { new CachedSamplerSound() };
+    std::atomic<bool> sampledSoundRequested { false };
+
+    OwnedArray<MultisampleInstrument> instruments;
+
+    // reads streamed samples from disk for the sampler voices
+    SampleStreamer sampleStreamer;
+
     // the synth itself!
-    Synthesiser synth;
-    float volume = 1; // Default volume
+    PolySynthesiser synth;
+    Array<SineWaveVoice*> sineWaveVoices; // owned by the synth
+    Array<CachedSamplerVoice*> samplerVoices;
+    std::atomic<int> numVoicesRequested { 16 };
+    int maximumBlockSize = 512;
+    std::atomic<double> currentSampleRate { 0.0 };
+    static constexpr int numOutputChannels = 2;
+
+    // the extra threads the voices are rendered on, if any
+    std::unique_ptr<VoiceRenderPool> renderPool;
+
+    // all the temporary buffers used while rendering, including the voices' ones
+    ScratchArena scratchArena;
+
+    SmoothedValue<float> volume { 1.0f };
+    float* gainRamp = nullptr;
     float smoothedGainCompensation = 1.0f; // Smoothed gain compensation
 
-    dsp::ProcessorDuplicator<dsp::IIR::Filter<float>, dsp::IIR::Coefficients<float>> filter;
+    // every voice's own filter; the voices scale this shared cutoff with
+    // their brightness controller and filter envelope
+    VoiceFilterBank voiceFilters;
+
+    // the voices render into oversampledBuffer, with oversampledMidi, when they run
+    // faster than the device, and the oversampler brings them back down
+    Oversampler oversampler;
+    AudioBuffer<float> oversampledBuffer;
+    MidiBuffer oversampledMidi;
+    std::atomic<int> oversamplingFactorRequested { 1 };
+    int oversamplingFactor = 1;
+    SmoothedValue<float, ValueSmoothingTypes::Multiplicative> cutoff { 1000.0f };
+    SmoothedValue<float> resonance { 0.7f };
 };
 
 //==============================================================================
 class Callback final : public AudioIODeviceCallback
 {
 public:
-    Callback (AudioSourcePlayer& playerIn, LiveScrollingAudioDisplay& displayIn)
-        : player (playerIn), display (displayIn) {}
+    Callback (AudioSourcePlayer& playerIn, AudioScope& displayIn, PerformanceMonitor& performanceIn)
+        : player (playerIn), display (displayIn), performance (performanceIn) {}
 
     void audioDeviceIOCallbackWithContext (const float* const* inputChannelData,
                                            int numInputChannels,
@@ -385,44 +898,41 @@ public:
                                            int numSamples,
                                            const AudioIODeviceCallbackContext& context) override
     {
+        performance.beginBlock (numSamples);
+
         player.audioDeviceIOCallbackWithContext (inputChannelData,
                                                  numInputChannels,
                                                  outputChannelData,
                                                  numOutputChannels,
                                                  numSamples,
                                                  context);
-        display.audioDeviceIOCallbackWithContext (outputChannelData,
-                                                  numOutputChannels,
-                                                  nullptr,
-                                                  0,
-                                                  numSamples,
-                                                  context);
+        {
+            // the display only takes a copy of the block here; it draws it on the GUI thread
+            PerformanceMonitor::ScopedStage stage (performance, PerformanceMonitor::displayTap);
+            display.pushBlock (outputChannelData, numOutputChannels, numSamples);
+        }
+
+        performance.endBlock();
     }
 
     void audioDeviceAboutToStart (AudioIODevice* device) override
     {
         player.audioDeviceAboutToStart (device);
-        display.audioDeviceAboutToStart (device);
+        performance.prepare (device->getCurrentSampleRate());
+        display.setSampleRate (device->getCurrentSampleRate());
+        display.requestClear();
     }
 
     void audioDeviceStopped() override
     {
         player.audioDeviceStopped();
-        display.audioDeviceStopped();
+        display.requestClear();
     }
 
 private:
     AudioSourcePlayer& player;
-    LiveScrollingAudioDisplay& display;
-};
-
-struct MidiLogger  : public MidiInputCallback
-{
-    void handleIncomingMidiMessage (MidiInput* /*source*/,
-                                    const MidiMessage& m) override
-    {
-        DBG ("MIDI Received: " << m.getDescription());
-    }
+    AudioScope& display;
+    PerformanceMonitor& performance;
 };
 
 //==============================================================================
@@ -453,6 +963,25 @@ public:
         addAndMakeVisible (sampledButton);
         sampledButton.setRadioGroupId (321);
         sampledButton.onClick = [this] { synthAudioSource.setUsingSampledSound(); };
+
+        addAndMakeVisible (voiceCountSelector);
+
+        for (auto numVoices = SynthAudioSource::minNumVoices; numVoices <= SynthAudioSource::maxNumVoices; numVoices *= 2)
+            voiceCountSelector.addItem (String (numVoices) + " voices", numVoices);
+
+        voiceCountSelector.setSelectedId (synthAudioSource.getNumVoices(), dontSendNotification);
+        voiceCountSelector.onChange = [this] { updateVoiceCount(); };
+
+        addAndMakeVisible (oversamplingSelector);
+
+        for (auto factor = 1; factor <= Oversampler::maxFactor; factor *= 2)
+            oversamplingSelector.addItem (factor == 1 ? String ("No oversampling") : String (factor) + "x oversampling", factor);
+
+        oversamplingSelector.setSelectedId (synthAudioSource.getOversamplingFactor(), dontSendNotification);
+        oversamplingSelector.onChange = [this] { updateOversampling(); };
+
+        addAndMakeVisible (traceButton);
+        traceButton.onClick = [this] { updateMidiTrace(); };
         addAndMakeVisible(volumeSlider);
                volumeSlider.setRange(0.0, 1.0);
                volumeSlider.setValue(0.5); // Default to 50% volume
@@ -460,7 +989,8 @@ public:
                volumeSlider.setTextBoxStyle(Slider::TextBoxBelow, false, 50, 20);
                volumeSlider.onValueChange = [this] { synthAudioSource.setVolume(volumeSlider.getValue()); };
         
-        addAndMakeVisible (liveAudioDisplayComp);
+        addAndMakeVisible (scope);
+        addAndMakeVisible (performanceOverlay);
         audioSourcePlayer.setSource (&synthAudioSource);
         addAndMakeVisible(waveTypeSelector);
         waveTypeSelector.addItem("Sine", 1);
@@ -470,6 +1000,14 @@ public:
         waveTypeSelector.onChange = [this] { updateWaveType(); };
         waveTypeSelector.setSelectedId(1);
 
+        addAndMakeVisible (filterTypeSelector);
+        filterTypeSelector.addItem ("Low-pass",  1 + (int) FilterType::lowPass);
+        filterTypeSelector.addItem ("High-pass", 1 + (int) FilterType::highPass);
+        filterTypeSelector.addItem ("Band-pass", 1 + (int) FilterType::bandPass);
+        filterTypeSelector.addItem ("Notch",     1 + (int) FilterType::notch);
+        filterTypeSelector.setSelectedId (1 + (int) FilterType::lowPass, dontSendNotification);
+        filterTypeSelector.onChange = [this] { synthAudioSource.setFilterType ((FilterType) (filterTypeSelector.getSelectedId() - 1)); };
+
         addAndMakeVisible(attackSlider);
                attackSlider.setRange(0.1f,5.0f); // Range from 10ms to 5 seconds
                attackSlider.setValue(0.1f); // Default to 100ms
@@ -477,13 +1015,7 @@ public:
                attackSlider.setTextBoxStyle(Slider::TextBoxBelow, false, 50, 20);
         attackSlider.onValueChange = [this]
         {
-            for (int i = 0; i < synthAudioSource.synth.getNumVoices(); ++i){
-                if (auto* voice = dynamic_cast<SineWaveVoice*>(synthAudioSource.synth.getVoice(i)))
-                {
-                    voice->setAttack(attackSlider.getValue());
-                }
-            }
-            
+            synthAudioSource.updateParameters ([value = (float) attackSlider.getValue()] (SynthParameters& p) { p.envelope.attack = value; });
         };
 
                addAndMakeVisible(decaySlider);
@@ -493,14 +1025,7 @@ public:
                decaySlider.setTextBoxStyle(Slider::TextBoxBelow, false, 50, 20);
         decaySlider.onValueChange = [this]
         {
-            for (int i = 0; i < synthAudioSource.synth.getNumVoices(); ++i){
-                if (auto* voice = dynamic_cast<SineWaveVoice*>(synthAudioSource.synth.getVoice(i)))
-                {
-                    voice->setDecay(decaySlider.getValue());
-                }
-                
-            }
-            
+            synthAudioSource.updateParameters ([value = (float) decaySlider.getValue()] (SynthParameters& p) { p.envelope.decay = value; });
         };
 
                addAndMakeVisible(sustainSlider);
@@ -510,13 +1035,7 @@ public:
                sustainSlider.setTextBoxStyle(Slider::TextBoxBelow, false, 50, 20);
         sustainSlider.onValueChange = [this]
         {
-            for (int i = 0; i < synthAudioSource.synth.getNumVoices(); ++i){
-                if (auto* voice = dynamic_cast<SineWaveVoice*>(synthAudioSource.synth.getVoice(i)))
-                            {
-                                voice->setSustain(sustainSlider.getValue());
-                            }
-            }
-            
+            synthAudioSource.updateParameters ([value = (float) sustainSlider.getValue()] (SynthParameters& p) { p.envelope.sustain = value; });
         };
 
 
@@ -527,17 +1046,21 @@ public:
                releaseSlider.setTextBoxStyle(Slider::TextBoxBelow, false, 50, 20);
         releaseSlider.onValueChange = [this]
         {
-            for (int i = 0; i < synthAudioSource.synth.getNumVoices(); ++i){
-                if (auto* voice = dynamic_cast<SineWaveVoice*>(synthAudioSource.synth.getVoice(i)))
-                            {
-                                voice->setRelease(releaseSlider.getValue());
-                            }
-            }
-            
+            synthAudioSource.updateParameters ([value = (float) releaseSlider.getValue()] (SynthParameters& p) { p.envelope.release = value; });
         };
 
     
 
+        // start the synth off with the values the controls are showing
+        synthAudioSource.updateParameters ([this] (SynthParameters& p)
+        {
+            p.envelope = { (float) attackSlider.getValue(), (float) decaySlider.getValue(),
+                           (float) sustainSlider.getValue(), (float) releaseSlider.getValue() };
+            p.volume = (float) volumeSlider.getValue();
+            p.cutoff = (float) cutoffSlider.getValue();
+            p.resonance = (float) resonanceSlider.getValue();
+        });
+
        #ifndef JUCE_DEMO_RUNNER
         audioDeviceManager.initialise (0, 2, nullptr, true, {}, nullptr);
        #endif
@@ -561,7 +1084,8 @@ public:
 
 
         audioDeviceManager.addAudioCallback (&callback);
-        audioDeviceManager.addMidiInputDeviceCallback ({}, &(synthAudioSource.midiCollector));
+        audioDeviceManager.addMidiInputDeviceCallback ({}, &(synthAudioSource.midiInputFifo));
+        audioDeviceManager.addMidiInputDeviceCallback ({}, &midiTrace);
 
         setOpaque (true);
         setSize (640, 480);
@@ -572,7 +1096,8 @@ public:
     ~AudioSynthesiserDemo() override
     {
         audioSourcePlayer.setSource (nullptr);
-        audioDeviceManager.removeMidiInputDeviceCallback ({}, &(synthAudioSource.midiCollector));
+        audioDeviceManager.removeMidiInputDeviceCallback ({}, &(synthAudioSource.midiInputFifo));
+        audioDeviceManager.removeMidiInputDeviceCallback ({}, &midiTrace);
         audioDeviceManager.removeAudioCallback (&callback);
     }
 
@@ -588,7 +1113,10 @@ public:
         keyboardComponent   .setBounds (8, 96, getWidth() - 16, 64);
         sineButton          .setBounds (16, 176, 150, 24);
         sampledButton       .setBounds (16, 200, 150, 24);
-        liveAudioDisplayComp.setBounds (8, 8, getWidth() - 16, 64);
+        voiceCountSelector  .setBounds (getWidth() - 166, 176, 150, 24);
+        traceButton         .setBounds (getWidth() - 166, 200, 150, 24);
+        scope               .setBounds (8, 8, getWidth() - 16, 64);
+        performanceOverlay  .setBounds (8, 74, getWidth() - 16, 18);
         attackSlider.setBounds(16, 350, 50, 120); // X, Y, Width, Height
         decaySlider.setBounds(80, 350, 50, 120);
         sustainSlider.setBounds(144, 350, 50, 120);
@@ -596,6 +1124,8 @@ public:
         cutoffSlider.setBounds(16, 240, getWidth() - 32, 24);
         resonanceSlider.setBounds(16, 270, getWidth() - 32, 24);
         waveTypeSelector.setBounds(16, 330, getWidth() - 32, 24);
+        filterTypeSelector  .setBounds (getWidth() - 166, 380, 150, 24);
+        oversamplingSelector.setBounds (getWidth() - 332, 380, 150, 24);
 
 
     }
@@ -607,19 +1137,13 @@ public:
             return;
 
         auto newID = devices[idx].identifier;
-        audioDeviceManager.addMidiInputDeviceCallback (newID, &midiLogger);
 
         // 1) Disable the previous port
         if (currentMidiInput.isNotEmpty())
             audioDeviceManager.setMidiInputDeviceEnabled (currentMidiInput, false);
 
-        audioDeviceManager.removeMidiInputDeviceCallback (currentMidiInput,
-                                                          &synthAudioSource.midiCollector);
-
-        // 2) Enable & register the new port
+        // 2) Enable the new port; the FIFO is registered once for every input, so it follows the change
         audioDeviceManager.setMidiInputDeviceEnabled (newID, true);
-        audioDeviceManager.addMidiInputDeviceCallback    (newID,
-                                                          &synthAudioSource.midiCollector);
 
         currentMidiInput = newID;
     }
@@ -640,22 +1164,28 @@ private:
 
     ToggleButton sineButton     { "Use sine wave" };
     ToggleButton sampledButton  { "Use sampled sound" };
+    ComboBox voiceCountSelector;
+    ComboBox oversamplingSelector;
+    ToggleButton traceButton    { "Record MIDI trace" };
 
-    LiveScrollingAudioDisplay liveAudioDisplayComp;
+    AudioScope scope;
 
-    Callback callback { audioSourcePlayer, liveAudioDisplayComp };
+    PerformanceOverlay performanceOverlay { synthAudioSource.performance, audioDeviceManager };
+
+    Callback callback { audioSourcePlayer, scope, synthAudioSource.performance };
     
     juce::Slider cutoffSlider;
     juce::Slider resonanceSlider;
     juce::Slider volumeSlider;
     ComboBox waveTypeSelector;
+    ComboBox filterTypeSelector;
     Slider attackSlider;
     Slider decaySlider;
     Slider sustainSlider;
     Slider releaseSlider;
     ComboBox midiInputList;
     String   currentMidiInput;
-    MidiLogger midiLogger;  // as a member alongside midiInputList
+    MidiTraceRecorder midiTrace;    // registered once for every input, so it follows device changes
     juce::AudioDeviceManager deviceManager; // [1]
     juce::Label midiInputListLabel;
     int lastInputIndex = 0; // [3]
@@ -667,13 +1197,47 @@ private:
     void updateWaveType()
     {
         auto selectedWave = static_cast<SineWaveVoice::WaveType>(waveTypeSelector.getSelectedId() - 1);
-        for (auto i = 0; i < synthAudioSource.synth.getNumVoices(); ++i)
+        synthAudioSource.setWaveType (selectedWave);
+    }
+
+    void updateVoiceCount()
+    {
+        synthAudioSource.setNumVoices (voiceCountSelector.getSelectedId());
+
+        // detaching and re-attaching the source makes the player call prepareToPlay()
+        // again while the source isn't in use, which is where the voices are allocated
+        audioSourcePlayer.setSource (nullptr);
+        audioSourcePlayer.setSource (&synthAudioSource);
+    }
+
+    void updateOversampling()
+    {
+        synthAudioSource.setOversamplingFactor (oversamplingSelector.getSelectedId());
+
+        // like the voice count, the factor is only applied by prepareToPlay()
+        audioSourcePlayer.setSource (nullptr);
+        audioSourcePlayer.setSource (&synthAudioSource);
+    }
+
+    void updateMidiTrace()
+    {
+        if (! traceButton.getToggleState())
+        {
+            midiTrace.stop();
+            return;
+        }
+
+        // each recording gets a new file, which can be replayed with the offline renderer's --trace option
+        const auto file = File::getSpecialLocation (File::userDocumentsDirectory)
+                              .getNonexistentChildFile ("MIDI trace", ".miditrace");
+
+        if (auto result = midiTrace.start (file); result.failed())
         {
-            if (auto* voice = dynamic_cast<SineWaveVoice*>(synthAudioSource.synth.getVoice(i)))
-                voice->setWaveType(selectedWave);
+            traceButton.setToggleState (false, dontSendNotification);
+            AlertWindow::showMessageBoxAsync (MessageBoxIconType::WarningIcon, "MIDI trace", result.getErrorMessage());
         }
     }
-    
+
 
 
    
@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    This file contains the startup code for the microbenchmarks.
+
+    It times the synth's kernels at a range of voice counts, block sizes and
+    sample rates, and writes the results as JSON so that they can be compared
+    from one commit to the next.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "SynthBenchmarks.h"
+
+// in debug builds, this makes any allocation on the audio thread hit an assertion
+SYNTH_DEFINE_REALTIME_ALLOCATION_HOOKS()
+
+//==============================================================================
+template <typename Type>
+static Array<Type> parseList (const ArgumentList& args, StringRef option, const Array<Type>& defaultValues)
+{
+    const auto value = args.getValueForOption (option);
+
+    if (value.isEmpty())
+        return defaultValues;
+
+    Array<Type> values;
+
+    for (const auto& item : StringArray::fromTokens (value, ",", {}))
+    {
+        const auto number = (Type) item.trim().getDoubleValue();
+
+        if (number <= 0)
+            ConsoleApplication::fail ("Bad value for " + String (option) + ": " + item);
+
+        values.add (number);
+    }
+
+    return values;
+}
+
+static void runBenchmarks (const ArgumentList& args)
+{
+    BenchmarkSettings settings;
+    settings.voiceCounts = parseList (args, "--voices", settings.voiceCounts);
+    settings.blockSizes  = parseList (args, "--blocks", settings.blockSizes);
+    settings.sampleRates = parseList (args, "--rates",  settings.sampleRates);
+
+    for (auto blockSize : settings.blockSizes)
+        if (blockSize < 16 || blockSize > 2048)
+            ConsoleApplication::fail ("Block sizes must be from 16 to 2048");
+
+    if (args.containsOption ("--cases"))
+        settings.cases = StringArray::fromTokens (args.getValueForOption ("--cases"), ",", {});
+
+    if (args.containsOption ("--time"))
+        settings.secondsPerTrial = jmax (0.001, args.getValueForOption ("--time").getDoubleValue());
+
+    if (args.containsOption ("--trials"))
+        settings.numTrials = jmax (1, args.getValueForOption ("--trials").getIntValue());
+
+    // the progress goes to stderr, so that stdout can be the JSON alone
+    std::vector<BenchmarkResult> results;
+    auto result = SynthBenchmarks (settings).run (results, [] (const BenchmarkResult& r)
+    {
+        std::cerr << r.caseName << ": " << r.numVoices << " voices, " << r.blockSize << " samples @ "
+                  << r.sampleRate << " Hz: " << String (r.nsPerSample, 1) << " ns/sample";
+
+        if (r.voicesPerCore > 0.0)
+            std::cerr << ", " << String (r.nsPerVoiceSample, 2) << " ns/voice-sample, "
+                      << roundToInt (r.voicesPerCore) << " voices/core";
+
+        std::cerr << std::endl;
+    });
+
+    if (result.failed())
+        ConsoleApplication::fail (result.getErrorMessage());
+
+    const auto json = SynthBenchmarks::toJson (results, args.getValueForOption ("--label"));
+
+    if (args.containsOption ("--out"))
+    {
+        const auto file = args.getFileForOption ("--out");
+
+        if (! file.replaceWithText (json))
+            ConsoleApplication::fail ("Couldn't write " + file.getFullPathName());
+    }
+    else
+    {
+        std::cout << json << std::endl;
+    }
+}
+
+static void listCases (const ArgumentList&)
+{
+    for (const auto& name : SynthBenchmarks::getCaseNames())
+        std::cout << name << std::endl;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ConsoleApplication app;
+
+    app.addHelpCommand ("--help|-h", "Usage:", false);
+
+    app.addCommand ({ "--list",
+                      "--list",
+                      "Prints the names of the benchmark cases.",
+                      {},
+                      listCases });
+
+    app.addDefaultCommand ({ "--run",
+                             "[--out=results.json] [options]",
+                             "Times the synth's kernels and prints the results as JSON.",
+                             "Options:\n"
+                             "  --voices=1,16,64     the voice counts to run each case with\n"
+                             "  --blocks=16,64,256,1024,2048   block sizes, from 16 to 2048\n"
+                             "  --rates=48000        sample rates in Hz\n"
+                             "  --cases=a,b          only run these cases; --list shows them all\n"
+                             "  --time=0.1           the minimum length of each trial, in seconds\n"
+                             "  --trials=5           trials per measurement; the median is reported\n"
+                             "  --label=abc123       stored in the JSON, e.g. the commit being measured\n"
+                             "  --out=results.json   write the JSON to a file instead of stdout",
+                             runBenchmarks });
+
+    return app.findAndRunCommand (argc, argv);
+}
@@ -0,0 +1,270 @@
+/*
+  ==============================================================================
+
+    This file contains the ADSR envelope used by the synth voices.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/**
+    An ADSR envelope that generates a whole block of gain values at once.
+
+    Rather than being asked for one sample at a time, the envelope knows how many
+    samples are left in its current segment and fills that whole span in one go,
+    so there's no per-sample state machine. Linear segments are written as
+    closed-form ramps; exponential segments are a geometric series towards a
+    target just beyond the segment's end, so that they finish in exactly the
+    time they were given, just like the linear ones.
+
+    The attack is always linear. The curve setting affects decay and release.
+    Parameter changes are picked up at the start of the next segment, apart from
+    the sustain level, which a held note follows straight away.
+*/
+class BlockEnvelope
+{
+public:
+    enum class Curve { linear, exponential };
+
+    BlockEnvelope() = default;
+
+    //==============================================================================
+    void setSampleRate (double newSampleRate) noexcept
+    {
+        jassert (newSampleRate > 0.0);
+        sampleRate = newSampleRate;
+    }
+
+    void setParameters (const ADSR::Parameters& newParameters) noexcept
+    {
+        jassert (newParameters.attack >= 0.0f && newParameters.decay >= 0.0f
+                  && newParameters.release >= 0.0f && isPositiveAndNotGreaterThan (newParameters.sustain, 1.0f));
+
+        parameters = newParameters;
+    }
+
+    const ADSR::Parameters& getParameters() const noexcept  { return parameters; }
+
+    void setCurve (Curve newCurve) noexcept                 { curve = newCurve; }
+
+    //==============================================================================
+    /** Starts the attack from wherever the envelope currently is. */
+    void noteOn() noexcept                          { startAttack(); }
+
+    /** Starts the release from wherever the envelope currently is. */
+    void noteOff() noexcept
+    {
+        if (state != State::idle)
+            startRelease();
+    }
+
+    void reset() noexcept
+    {
+        state = State::idle;
+        value = 0.0f;
+        samplesLeft = 0;
+    }
+
+    bool isActive() const noexcept                  { return state != State::idle; }
+    bool isReleasing() const noexcept               { return state == State::release; }
+    float getCurrentLevel() const noexcept          { return value; }
+
+    //==============================================================================
+    /** Writes the next numSamples gain values into dest, advancing the envelope
+        by exactly that many samples. Once the envelope has finished, the rest of
+        the block is filled with zeros.
+    */
+    void fillGainCurve (float* dest, int numSamples) noexcept
+    {
+        while (numSamples > 0)
+        {
+            if (state == State::idle)
+            {
+                FloatVectorOperations::clear (dest, numSamples);
+                return;
+            }
+
+            if (state == State::sustain)
+            {
+                value = parameters.sustain;
+                FloatVectorOperations::fill (dest, value, numSamples);
+                return;
+            }
+
+            const auto num = jmin (numSamples, samplesLeft);
+
+            if (isExponential)
+                fillExponential (dest, num);
+            else
+                fillLinear (dest, num);
+
+            dest += num;
+            numSamples -= num;
+            samplesLeft -= num;
+
+            if (samplesLeft == 0)
+                finishSegment();
+        }
+    }
+
+    /** Advances the envelope by numSamples without writing anything, and returns the
+        level it gets to. This is for envelopes that are only read at control rate.
+    */
+    float skip (int numSamples) noexcept
+    {
+        while (numSamples > 0 && state != State::idle)
+        {
+            if (state == State::sustain)
+            {
+                value = parameters.sustain;
+                break;
+            }
+
+            const auto num = jmin (numSamples, samplesLeft);
+
+            if (isExponential)
+            {
+                const auto curveTarget = target - overshoot;
+                value = curveTarget + (value - curveTarget) * std::pow (step, (float) num);
+            }
+            else
+            {
+                value += step * (float) num;
+            }
+
+            numSamples -= num;
+            samplesLeft -= num;
+
+            if (samplesLeft == 0)
+                finishSegment();
+        }
+
+        return value;
+    }
+
+private:
+    enum class State { idle, attack, decay, sustain, release };
+
+    // exponential segments aim this far past their end point, which sets how curved they are
+    static constexpr float overshoot = 0.001f;
+
+    //==============================================================================
+    void startAttack() noexcept
+    {
+        if (parameters.attack <= 0.0f || value >= 1.0f)
+        {
+            startDecay();
+            return;
+        }
+
+        startSegment (State::attack, 1.0f, (1.0f - value) * parameters.attack, false);
+    }
+
+    void startDecay() noexcept
+    {
+        value = 1.0f;
+
+        if (parameters.decay <= 0.0f || parameters.sustain >= 1.0f)
+            startSustain();
+        else
+            startSegment (State::decay, parameters.sustain, parameters.decay, curve == Curve::exponential);
+    }
+
+    void startSustain() noexcept
+    {
+        state = State::sustain;
+        value = parameters.sustain;
+    }
+
+    void startRelease() noexcept
+    {
+        if (parameters.release <= 0.0f || value <= 0.0f)
+        {
+            reset();
+            return;
+        }
+
+        auto duration = parameters.release;
+
+        // an exponential release keeps the slope it would have had from full level,
+        // so it takes less time from a lower one, the same way a real RC decay does
+        if (curve == Curve::exponential)
+            duration *= std::log (overshoot / (value + overshoot)) / std::log (overshoot / (1.0f + overshoot));
+
+        startSegment (State::release, 0.0f, duration, curve == Curve::exponential);
+    }
+
+    void startSegment (State newState, float newTarget, float durationInSeconds, bool exponential) noexcept
+    {
+        state = newState;
+        target = newTarget;
+        isExponential = exponential;
+        samplesLeft = jmax (1, roundToInt (durationInSeconds * sampleRate));
+
+        if (exponential)
+        {
+            // takes the distance to (target - overshoot) down to just the overshoot in samplesLeft steps
+            const auto curveTarget = target - overshoot;
+            step = (float) std::exp (std::log (overshoot / (value - curveTarget)) / samplesLeft);
+        }
+        else
+        {
+            step = (target - value) / (float) samplesLeft;
+        }
+    }
+
+    void finishSegment() noexcept
+    {
+        value = target;
+
+        switch (state)
+        {
+            case State::attack:     startDecay(); break;
+            case State::decay:      startSustain(); break;
+            case State::release:    reset(); break;
+            case State::idle:
+            case State::sustain:
+            default:                break;
+        }
+    }
+
+    //==============================================================================
+    void fillLinear (float* dest, int numSamples) noexcept
+    {
+        const auto start = value;
+
+        for (auto i = 0; i < numSamples; ++i)
+            dest[i] = start + step * (float) i;
+
+        value = start + step * (float) numSamples;
+    }
+
+    void fillExponential (float* dest, int numSamples) noexcept
+    {
+        const auto curveTarget = target - overshoot;
+        auto distance = value - curveTarget;
+
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            dest[i] = curveTarget + distance;
+            distance *= step;
+        }
+
+        value = curveTarget + distance;
+    }
+
+    //==============================================================================
+    ADSR::Parameters parameters;
+    Curve curve = Curve::linear;
+    double sampleRate = 44100.0;
+
+    State state = State::idle;
+    float value = 0.0f, target = 0.0f;
+
+    // the per-sample increment of a linear segment, or the per-sample ratio of an exponential one
+    float step = 0.0f;
+    bool isExponential = false;
+    int samplesLeft = 0;
+};
@@ -0,0 +1,436 @@
+/*
+  ==============================================================================
+
+    This file contains the sampler sound and voice that play samples from a
+    SampleCache, either from memory or streamed from disk.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SampleCache.h"
+#include "MultisampleInstrument.h"
+#include "SampleStreamer.h"
+#include "SincResampler.h"
+#include "SynthParameters.h"
+#include "BlockEnvelope.h"
+#include "ScratchArena.h"
+#include "PolySynthesiser.h"
+#include "VoiceFilterBank.h"
+
+//==============================================================================
+/**
+    A sampler sound whose sample can be swapped while it's playing.
+
+    The sound plays either one sample across the whole keyboard, or a
+    MultisampleInstrument. Both live elsewhere, so the sound only holds a pointer to
+    one of them, and changing it is a single atomic store. Voices pick the sample up
+    when they start a note, so notes that are already playing finish with the sample
+    they started with.
+*/
+class CachedSamplerSound final : public SynthesiserSound
+{
+public:
+    CachedSamplerSound() = default;
+
+    /** Sets the sample to play, which must stay alive for as long as this sound does.
+        The root note is the note at which the sample plays at its own pitch.
+    */
+    void setSample (const CachedSample* newSample, int newRootNote) noexcept
+    {
+        rootNote.store (newRootNote, std::memory_order_relaxed);
+        sample.store (newSample, std::memory_order_release);
+        instrument.store (nullptr, std::memory_order_release);
+    }
+
+    /** Sets a multisampled instrument to play instead, which must stay alive for as
+        long as this sound does.
+    */
+    void setInstrument (MultisampleInstrument* newInstrument) noexcept
+    {
+        instrument.store (newInstrument, std::memory_order_release);
+    }
+
+    /** Returns the zone to play for a note-on, or an empty zone if there's nothing to
+        play. Call this from the audio thread only, as it moves the instrument's
+        round-robin groups on.
+    */
+    SampleZone selectZone (int midiNoteNumber, float velocity) noexcept
+    {
+        if (auto* currentInstrument = instrument.load (std::memory_order_acquire))
+        {
+            const auto* zone = currentInstrument->selectZone (midiNoteNumber, jlimit (1, 127, roundToInt (velocity * 127.0f)));
+            return zone != nullptr ? *zone : SampleZone();
+        }
+
+        SampleZone zone;
+        zone.sample = getSample();
+        zone.rootNote = getRootNote();
+        return zone;
+    }
+
+    const CachedSample* getSample() const noexcept      { return sample.load (std::memory_order_acquire); }
+    int getRootNote() const noexcept                    { return rootNote.load (std::memory_order_relaxed); }
+
+    /** The envelope applied to every note; the sample's own decay does the rest. */
+    ADSR::Parameters envelope { 0.1f, 0.0f, 1.0f, 0.1f };
+
+    bool appliesToNote (int) override       { return true; }
+    bool appliesToChannel (int) override    { return true; }
+
+private:
+    std::atomic<const CachedSample*> sample { nullptr };
+    std::atomic<int> rootNote { 60 };
+    std::atomic<MultisampleInstrument*> instrument { nullptr };
+};
+
+//==============================================================================
+/**
+    Plays a CachedSamplerSound, pitched by the note's distance from the root note.
+
+    The pitching is done by a SincResampler kernel, picked from the quality in the
+    synth's parameters and from how far the note is transposed, including any bend or
+    vibrato from the voice's VoiceModulator.
+
+    A streamed sample plays from its resident head first, then from the voice's
+    SampleStream, which the SampleStreamer's thread has been filling since the note
+    started.
+*/
+class CachedSamplerVoice final : public PolySynthesiserVoice
+{
+public:
+    static_assert (SincResampler::maxNumTaps <= SampleStream::guardSize, "A kernel's window has to fit in the stream's guard frames");
+    static_assert (SincResampler::maxNumTaps <= CachedSample::streamOverlap, "A kernel's window has to fit in the head's overlap with the stream");
+
+    CachedSamplerVoice() = default;
+
+    bool canPlaySound (SynthesiserSound* sound) override
+    {
+        return dynamic_cast<CachedSamplerSound*> (sound) != nullptr;
+    }
+
+    void startNote (int midiNoteNumber, float velocity, SynthesiserSound* s, int /*currentPitchWheelPosition*/) override
+    {
+        auto* sound = dynamic_cast<CachedSamplerSound*> (s);
+        const auto zone = sound != nullptr ? sound->selectZone (midiNoteNumber, velocity) : SampleZone();
+        sample = zone.sample;
+
+        if (sample == nullptr || sample->data.getNumSamples() == 0 || resampler == nullptr || ! resampler->isBuilt())
+        {
+            clearCurrentNote();
+            return;
+        }
+
+        pitchRatio = std::pow (2.0, (midiNoteNumber - zone.rootNote) / 12.0)
+                       * sample->sampleRate / getSampleRate();
+        sourceSamplePosition = 0.0;
+        gain = velocity * zone.gain;
+
+        if (parameters != nullptr)
+        {
+            quality = parameters->getSnapshot().resamplingQuality;
+            modulation = parameters->getSnapshot().modulation;
+        }
+
+        modulator.startNote (getChannelState(), modulation, getSampleRate());
+        kernel = resampler->getKernel (quality, pitchRatio);
+
+        if (sample->isStreamed() && stream != nullptr)
+            streamGeneration = stream->start (sample);
+
+        envelope.setSampleRate (getSampleRate());
+        envelope.setParameters (sound->envelope);
+        envelope.noteOn();
+    }
+
+    void stopNote (float /*velocity*/, bool allowTailOff) override
+    {
+        modulator.stopNote (allowTailOff);
+
+        if (allowTailOff)
+        {
+            envelope.noteOff();
+        }
+        else
+        {
+            clearCurrentNote();
+            envelope.reset();
+
+            if (sample != nullptr && sample->isStreamed() && stream != nullptr)
+                stream->stop();
+
+            sample = nullptr;
+        }
+    }
+
+    // the modulator reads the channel's pitch wheel and controllers as it renders
+    void pitchWheelMoved (int) override         {}
+    void controllerMoved (int, int) override    {}
+
+    float getCurrentLevel() const noexcept override
+    {
+        return gain * envelope.getCurrentLevel() * modulator.getCurrentLevel();
+    }
+
+    //==============================================================================
+    /** Returns how much of a ScratchArena prepareScratch() will use. */
+    static size_t getScratchSizeNeeded (int maximumBlockSize) noexcept
+    {
+        return 3 * ScratchArena::getAllocationSize ((size_t) maximumBlockSize);
+    }
+
+    /** Takes the blocks the voice renders into before mixing from an arena. */
+    void prepareScratch (ScratchArena& arena, int maximumBlockSize)
+    {
+        left          = arena.allocate ((size_t) maximumBlockSize);
+        right         = arena.allocate ((size_t) maximumBlockSize);
+        envelopeCurve = arena.allocate ((size_t) maximumBlockSize);
+        scratchSize   = left != nullptr && right != nullptr && envelopeCurve != nullptr ? maximumBlockSize : 0;
+    }
+
+    /** Sets the shared kernel tables the voice pitches samples with. */
+    void setResampler (const SincResampler* newResampler) noexcept      { resampler = newResampler; }
+
+    /** Sets the store the voice reads the resampling quality from. */
+    void setParameterStore (const SynthParameterStore* newParameters) noexcept  { parameters = newParameters; }
+
+    /** Sends the voice's left and right channels through their own filters, in two
+        neighbouring slots of a bank, instead of mixing them straight into the output.
+    */
+    void setFilterBank (VoiceFilterBank* newFilterBank, int firstSlot) noexcept
+    {
+        filterBank = newFilterBank;
+        filterSlot = firstSlot;
+    }
+
+    /** Gives the voice the stream it plays streamed samples from. Without one, it
+        only plays their heads.
+    */
+    void prepareStream (SampleStreamer& newStreamer, int streamIndex) noexcept
+    {
+        streamer = &newStreamer;
+        stream = newStreamer.getStream (streamIndex);
+    }
+
+    void renderNextBlock (AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override
+    {
+        if (sample == nullptr || scratchSize == 0)
+            return;
+
+        while (numSamples > 0)
+        {
+            const auto numThisTime = jmin (numSamples, scratchSize);
+            auto numRendered = 0;
+
+            envelope.fillGainCurve (envelopeCurve, numThisTime);
+
+            while (numRendered < numThisTime)
+            {
+                const auto numInStep = jmin (numThisTime - numRendered, VoiceModulator::controlInterval);
+                const auto ramp = modulator.advance (getChannelState(), modulation, numInStep);
+
+                // the read position glides from one control value's speed to the next,
+                // and the kernel is the one for the faster end
+                const auto startRatio = pitchRatio * ramp.pitchStart;
+                const auto endRatio   = pitchRatio * ramp.pitchEnd;
+                currentRatio = startRatio;
+                ratioStep = (endRatio - startRatio) / numInStep;
+                kernel = resampler->getKernel (quality, jmax (startRatio, endRatio));
+
+                VoiceModulator::multiplyByRamp (envelopeCurve + numRendered, ramp.levelStart, ramp.levelEnd, numInStep);
+
+                if (filterBank != nullptr)
+                {
+                    filterBank->setCutoffScale (filterSlot,     startSample + numRendered, numInStep, ramp.cutoffEnd);
+                    filterBank->setCutoffScale (filterSlot + 1, startSample + numRendered, numInStep, ramp.cutoffEnd);
+                }
+
+                const auto end = readSample (numRendered, numRendered + numInStep);
+                const auto reachedEnd = end < numRendered + numInStep;
+                numRendered = end;
+
+                if (reachedEnd)
+                    break;
+            }
+
+            FloatVectorOperations::multiply (left,  envelopeCurve, numRendered);
+            FloatVectorOperations::multiply (right, envelopeCurve, numRendered);
+
+            if (filterBank != nullptr)
+            {
+                // a mono output gets both filtered channels, so they go in at half level
+                const auto channelGain = outputBuffer.getNumChannels() > 1 ? gain : gain * 0.5f;
+                filterBank->addInput (filterSlot,     startSample, left,  channelGain, numRendered);
+                filterBank->addInput (filterSlot + 1, startSample, right, channelGain, numRendered);
+            }
+            else if (outputBuffer.getNumChannels() > 1)
+            {
+                FloatVectorOperations::addWithMultiply (outputBuffer.getWritePointer (0, startSample), left,  gain, numRendered);
+                FloatVectorOperations::addWithMultiply (outputBuffer.getWritePointer (1, startSample), right, gain, numRendered);
+            }
+            else
+            {
+                FloatVectorOperations::addWithMultiply (outputBuffer.getWritePointer (0, startSample), left,  gain * 0.5f, numRendered);
+                FloatVectorOperations::addWithMultiply (outputBuffer.getWritePointer (0, startSample), right, gain * 0.5f, numRendered);
+            }
+
+            if (numRendered < numThisTime || ! envelope.isActive())
+            {
+                stopNote (0.0f, false);
+                return;
+            }
+
+            startSample += numThisTime;
+            numSamples  -= numThisTime;
+        }
+    }
+
+    using SynthesiserVoice::renderNextBlock;
+
+private:
+    /** Reads pitched samples into left and right from startIndex up to endIndex, and
+        returns the index it got to before the end of the sample.
+    */
+    int readSample (int startIndex, int endIndex) noexcept
+    {
+        const auto numRead = readResident (startIndex, endIndex);
+
+        if (numRead == endIndex || ! sample->isStreamed() || stream == nullptr)
+            return numRead;
+
+        return readStreamed (numRead, endIndex);
+    }
+
+    int readResident (int startIndex, int endIndex) noexcept
+    {
+        const auto& data = sample->data;
+        const auto length = (int64) data.getNumSamples();
+        const auto* inL = data.getReadPointer (0);
+        const auto* inR = data.getNumChannels() > 1 ? data.getReadPointer (1) : inL;
+        const auto halfLength = kernel.getHalfLength();
+
+        // a streamed sample's head hands over to the stream while the kernel still fits
+        // inside it; a resident sample plays until the kernel has run off its end
+        const auto end = sample->isStreamed() ? length - halfLength : length;
+
+        for (auto i = startIndex; i < endIndex; ++i)
+        {
+            const auto position = (int64) sourceSamplePosition;
+
+            if (position >= end)
+                return i;
+
+            const auto fraction = (float) (sourceSamplePosition - (double) position);
+
+            if (position >= halfLength - 1 && position + halfLength < length)
+                SincResampler::renderFrame (kernel, inL + position - (halfLength - 1), inR + position - (halfLength - 1),
+                                            fraction, left[i], right[i]);
+            else
+                SincResampler::renderFrameAtEdge (kernel, inL, inR, length, position, fraction, left[i], right[i]);
+
+            advancePosition();
+        }
+
+        return endIndex;
+    }
+
+    int readStreamed (int startIndex, int endIndex) noexcept
+    {
+        const auto streamStart = sample->getStreamStart();
+        const auto length = sample->lengthInSamples;
+        const auto* inL = stream->getReadPointer (0);
+        const auto* inR = stream->getReadPointer (1);
+        const auto mask = (int64) stream->getRingSize() - 1;
+        const auto halfLength = kernel.getHalfLength();
+        auto numAvailable = stream->getNumFramesAvailable (streamGeneration);
+
+        // the frame the kernel's window starts at, relative to the stream start
+        auto windowStart = [&] { return (int64) sourceSamplePosition - (halfLength - 1) - streamStart; };
+
+        for (auto i = startIndex; i < endIndex; ++i)
+        {
+            const auto position = (int64) sourceSamplePosition;
+
+            if (position + halfLength >= length)
+                return i;
+
+            const auto firstFrame = windowStart();
+            const auto lastFrame = firstFrame + kernel.numTaps - 1;
+            jassert (firstFrame >= 0);
+
+            if (lastFrame >= numAvailable)
+            {
+                stream->release (firstFrame);
+
+                if (streamer->isNonRealtime())
+                    numAvailable = waitForFrames (lastFrame + 1);
+
+                if (lastFrame >= numAvailable)
+                {
+                    // the reader has fallen behind, so hold the play head where it is
+                    // and leave a gap, rather than play whatever is in the ring
+                    streamer->reportUnderrun();
+                    FloatVectorOperations::clear (left + i, endIndex - i);
+                    FloatVectorOperations::clear (right + i, endIndex - i);
+                    return endIndex;
+                }
+            }
+
+            // the ring's guard frames mean a whole window can always be read without wrapping
+            const auto index = (int) (firstFrame & mask);
+            SincResampler::renderFrame (kernel, inL + index, inR + index,
+                                        (float) (sourceSamplePosition - (double) position), left[i], right[i]);
+
+            advancePosition();
+        }
+
+        stream->release (jlimit ((int64) 0, numAvailable, windowStart()));
+        return endIndex;
+    }
+
+    void advancePosition() noexcept
+    {
+        sourceSamplePosition += currentRatio;
+        currentRatio += ratioStep;
+    }
+
+    /** Only used when rendering offline, where it's fine to wait for the disk. */
+    int64 waitForFrames (int64 numNeeded) const noexcept
+    {
+        const auto timeout = Time::getMillisecondCounter() + 5000;
+        auto numAvailable = stream->getNumFramesAvailable (streamGeneration);
+
+        while (numAvailable < numNeeded && Time::getMillisecondCounter() < timeout)
+        {
+            Thread::yield();
+            numAvailable = stream->getNumFramesAvailable (streamGeneration);
+        }
+
+        return numAvailable;
+    }
+
+    const CachedSample* sample = nullptr;
+    const SincResampler* resampler = nullptr;
+    const SynthParameterStore* parameters = nullptr;
+    SincResampler::Kernel kernel;
+    ResamplingQuality quality = ResamplingQuality::standard;
+    double pitchRatio = 1.0, sourceSamplePosition = 0.0;
+    double currentRatio = 1.0, ratioStep = 0.0;    // the pitch ratio with modulation, and how it's gliding
+    float gain = 0.0f;
+    BlockEnvelope envelope;
+    VoiceModulator modulator;
+    ModulationParameters modulation;
+
+    VoiceFilterBank* filterBank = nullptr;
+    int filterSlot = 0;
+
+    SampleStreamer* streamer = nullptr;
+    SampleStream* stream = nullptr;
+    uint32 streamGeneration = 0;
+
+    float* left = nullptr;              // these point into the SynthAudioSource's ScratchArena
+    float* right = nullptr;
+    float* envelopeCurve = nullptr;
+    int scratchSize = 0;
+};
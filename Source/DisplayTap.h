@@ -0,0 +1,106 @@
+/*
+  ==============================================================================
+
+    This file contains the lock-free tap that carries the audio callback's output
+    to the GUI's displays.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SpscIndexPair.h"
+
+//==============================================================================
+/**
+    A single-producer, single-consumer ring of audio, for showing what the audio
+    thread is playing without the audio thread doing any work for the display.
+
+    The audio thread copies each whole block in with push(), which is one memcpy
+    per channel, or two where the ring wraps. Everything the display needs to do
+    with the samples, like mixing the channels and finding the peaks, happens after
+    the GUI thread has taken them out with pop(). If the GUI falls behind, or
+    isn't reading at all because the display is hidden, whole blocks are dropped
+    and counted, rather than the audio thread ever waiting.
+
+    The ring is allocated when the tap is created, and never again.
+*/
+class DisplayTap
+{
+public:
+    static constexpr int maxNumChannels = 2;
+    static constexpr int capacity = 1 << 15;    // in samples per channel
+
+    DisplayTap()
+    {
+        for (auto& channel : channels)
+            channel.resize ((size_t) capacity);
+    }
+
+    /** Audio thread: copies a block into the ring. Channels past maxNumChannels are
+        left out, and missing ones are written as silence.
+    */
+    void push (const float* const* data, int numChannels, int numSamples) noexcept
+    {
+        if (numSamples > indexes.getFreeSpace())
+        {
+            numDropped.fetch_add (numSamples, std::memory_order_relaxed);
+            return;
+        }
+
+        const auto start = indexes.wrap (indexes.getWriteIndex());
+        const auto numBeforeWrap = jmin (numSamples, capacity - start);
+
+        for (auto channel = 0; channel < maxNumChannels; ++channel)
+        {
+            auto* dest = channels[(size_t) channel].data();
+            const auto* source = channel < numChannels ? data[channel] : nullptr;
+
+            if (source == nullptr)
+            {
+                FloatVectorOperations::clear (dest + start, numBeforeWrap);
+                FloatVectorOperations::clear (dest, numSamples - numBeforeWrap);
+            }
+            else
+            {
+                std::memcpy (dest + start, source, (size_t) numBeforeWrap * sizeof (float));
+                std::memcpy (dest, source + numBeforeWrap, (size_t) (numSamples - numBeforeWrap) * sizeof (float));
+            }
+        }
+
+        indexes.finishedWrite (numSamples);
+    }
+
+    /** GUI thread: moves up to maxSamples from each channel of the ring into dest,
+        which must have maxNumChannels channels, and returns how many it moved.
+    */
+    int pop (float* const* dest, int maxSamples) noexcept
+    {
+        const auto numSamples = jmin (maxSamples, indexes.getNumReady());
+        const auto start = indexes.wrap (indexes.getReadIndex());
+        const auto numBeforeWrap = jmin (numSamples, capacity - start);
+
+        for (auto channel = 0; channel < maxNumChannels; ++channel)
+        {
+            const auto* source = channels[(size_t) channel].data();
+            std::memcpy (dest[channel], source + start, (size_t) numBeforeWrap * sizeof (float));
+            std::memcpy (dest[channel] + numBeforeWrap, source, (size_t) (numSamples - numBeforeWrap) * sizeof (float));
+        }
+
+        indexes.finishedRead (numSamples);
+        return numSamples;
+    }
+
+    /** GUI thread: throws away everything that's waiting in the ring. */
+    void discardAll() noexcept              { indexes.discardAll(); }
+
+    /** Returns how many samples the audio thread has had to drop because the ring was full. */
+    int getNumDropped() const noexcept      { return numDropped.load (std::memory_order_relaxed); }
+
+private:
+    std::array<std::vector<float>, (size_t) maxNumChannels> channels;
+    SpscIndexPair<capacity> indexes;
+    std::atomic<int> numDropped { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (DisplayTap)
+};
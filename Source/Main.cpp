@@ -9,6 +9,9 @@
 #include <JuceHeader.h>
 #include "AudioSynthesiserDemo.h"
 
+// in debug builds, this makes any allocation on the audio thread hit an assertion
+SYNTH_DEFINE_REALTIME_ALLOCATION_HOOKS()
+
 class Application    : public juce::JUCEApplication
 {
 public:
@@ -0,0 +1,183 @@
+/*
+  ==============================================================================
+
+    This file contains the per-block MIDI event list used by PolySynthesiser.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/**
+    Collects a block's MIDI events into a fixed-size list, sorts them by sample
+    position, and drops controller changes that are overtaken within the block.
+
+    A controller sweep can send a message every few samples, but only the last value
+    of each continuous controller, pitch wheel and channel pressure before the next
+    note or switch-type event matters, so the rest are removed. Pedals, mode messages,
+    program changes and notes are always kept, and always keep their order.
+
+    Only messages of up to three bytes are kept; the synth has no use for sysex.
+    Nothing here allocates after prepare().
+*/
+class MidiEventScheduler
+{
+public:
+    struct Event
+    {
+        MidiMessage toMessage() const noexcept      { return MidiMessage (data, (int) size); }
+
+        int samplePosition = 0;
+        uint32 order = 0;           // the order events were added in, to keep sorting stable
+        uint8 data[3] {};
+        uint8 size = 0;
+    };
+
+    MidiEventScheduler() = default;
+
+    /** Allocates room for a block's events. Call this from prepareToPlay(). */
+    void prepare (int maxEventsPerBlock)
+    {
+        events.resize ((size_t) maxEventsPerBlock);
+        stamps.assign (numKeys, 0);
+        numEvents = 0;
+    }
+
+    void clear() noexcept       { numEvents = 0; }
+
+    /** Adds a short message. Returns false if it isn't a short message, or if the
+        list is full.
+    */
+    bool add (const uint8* data, int size, int samplePosition) noexcept
+    {
+        if (size < 1 || size > 3 || (size_t) numEvents >= events.size())
+            return false;
+
+        auto& event = events[(size_t) numEvents];
+        event.samplePosition = samplePosition;
+        event.order = (uint32) numEvents;
+        event.size = (uint8) size;
+        std::copy (data, data + size, event.data);
+
+        ++numEvents;
+        return true;
+    }
+
+    /** Adds the events from one region of a MidiBuffer. */
+    void addEvents (const MidiBuffer& buffer, int startSample, int numSamples) noexcept
+    {
+        for (const auto metadata : buffer.findNextSamplePosition (startSample))
+        {
+            if (metadata.samplePosition >= startSample + numSamples)
+                break;
+
+            if (! add (metadata.data, metadata.numBytes, metadata.samplePosition))
+                jassert (metadata.numBytes > 3); // the list is full: prepare() needs a bigger number
+        }
+    }
+
+    /** Puts the events in order and removes the redundant controller changes. */
+    void sortAndCoalesce() noexcept
+    {
+        std::sort (events.begin(), events.begin() + numEvents, [] (const Event& a, const Event& b)
+        {
+            return a.samplePosition != b.samplePosition ? a.samplePosition < b.samplePosition
+                                                        : a.order < b.order;
+        });
+
+        // walking backwards, the first change seen for each controller since the last
+        // structural event is the one that survives; a stamp marks it as seen
+        nextStamp();
+
+        for (auto i = numEvents; --i >= 0;)
+        {
+            auto& event = events[(size_t) i];
+            const auto key = getCoalescingKey (event);
+
+            if (key < 0)
+            {
+                if (key == structural)
+                    nextStamp();
+
+                continue;
+            }
+
+            if (stamps[(size_t) key] == stamp)
+                event.size = 0;     // overtaken by a later change in the same stretch
+            else
+                stamps[(size_t) key] = stamp;
+        }
+
+        // std::stable_partition might allocate, so the survivors are packed down by hand
+        auto kept = 0;
+
+        for (auto i = 0; i < numEvents; ++i)
+            if (events[(size_t) i].size != 0)
+                events[(size_t) kept++] = events[(size_t) i];
+
+        numCoalesced += numEvents - kept;
+        numEvents = kept;
+    }
+
+    const Event* begin() const noexcept     { return events.data(); }
+    const Event* end() const noexcept       { return events.data() + numEvents; }
+    int size() const noexcept               { return numEvents; }
+
+    /** Returns how many events have been dropped as redundant so far. */
+    int64 getNumCoalesced() const noexcept  { return numCoalesced; }
+
+private:
+    static constexpr int pitchWheelKey = 128, channelPressureKey = 129, keysPerChannel = 130;
+    static constexpr int numKeys = 16 * keysPerChannel;
+    static constexpr int structural = -1, neutral = -2;
+
+    /** Returns the slot a continuous message is coalesced in, or one of the negative
+        values for messages that are kept.
+    */
+    static int getCoalescingKey (const Event& event) noexcept
+    {
+        const auto status = event.data[0] & 0xf0;
+        const auto channel = event.data[0] & 0x0f;
+
+        if (event.size == 3 && status == 0xb0)
+            return isContinuousController (event.data[1]) ? channel * keysPerChannel + event.data[1] : structural;
+
+        if (event.size == 3 && status == 0xe0)
+            return channel * keysPerChannel + pitchWheelKey;
+
+        if (event.size == 2 && status == 0xd0)
+            return channel * keysPerChannel + channelPressureKey;
+
+        // polyphonic aftertouch is per note, so it isn't coalesced, but it doesn't
+        // change which notes are playing either
+        return status == 0xa0 ? neutral : structural;
+    }
+
+    static bool isContinuousController (int controller) noexcept
+    {
+        return ! (controller == 0 || controller == 32          // bank select
+                   || controller == 6 || controller == 38      // data entry
+                   || (controller >= 64 && controller <= 69)   // pedals and switches
+                   || (controller >= 96 && controller <= 101)  // (N)RPN selection
+                   || controller >= 120);                      // channel mode messages
+    }
+
+    void nextStamp() noexcept
+    {
+        if (++stamp == 0)
+        {
+            std::fill (stamps.begin(), stamps.end(), 0);
+            stamp = 1;
+        }
+    }
+
+    std::vector<Event> events;
+    int numEvents = 0;
+
+    std::vector<uint32> stamps;
+    uint32 stamp = 0;
+    int64 numCoalesced = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (MidiEventScheduler)
+};
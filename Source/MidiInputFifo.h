@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    This file contains the lock-free queue that carries MIDI input to the audio
+    thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SpscIndexPair.h"
+
+//==============================================================================
+/**
+    A wait-free, single-producer, single-consumer queue of short MIDI messages, which
+    replaces MidiMessageCollector between the MIDI input and the audio callback.
+
+    MidiMessageCollector takes the same lock when a message arrives as when the audio
+    thread collects them, so a busy MIDI thread could hold up the callback. Here the
+    two sides only share a pair of indexes into a fixed ring of records: pushing a
+    message and collecting a block never wait, and never allocate. If the ring is full,
+    new messages are dropped and counted rather than blocking the device thread.
+
+    Each record is stamped with the device's sample clock when it arrives, so the audio
+    thread can place it within a block. Like MidiMessageCollector, messages are played
+    one block late, which keeps their spacing intact.
+
+    AudioDeviceManager calls its MIDI callbacks under its own lock, so even with several
+    inputs enabled there's only ever one producer at a time. Sysex and other long
+    messages are ignored; the synth has no use for them.
+*/
+class MidiInputFifo final : public MidiInputCallback
+{
+public:
+    static constexpr int capacity = 1024;   // in messages, fewer than the callback's MidiBuffer holds
+
+    MidiInputFifo() = default;
+
+    /** Starts the sample clock for a new sample rate, and forgets anything that
+        arrived before. Call this from prepareToPlay(), before the audio thread starts
+        reading.
+    */
+    void prepare (double newSampleRate)
+    {
+        jassert (newSampleRate > 0.0);
+
+        sampleRate.store (newSampleRate);
+        clockOrigin.store (Time::getMillisecondCounterHiRes() * 0.001);
+        indexes.discardAll();
+    }
+
+    /** Producer: queues a message, stamped with its arrival time on the sample clock. */
+    void handleIncomingMidiMessage (MidiInput*, const MidiMessage& message) override
+    {
+        const auto size = message.getRawDataSize();
+
+        if (size < 1 || size > 3)
+            return;
+
+        if (indexes.getFreeSpace() == 0)
+        {
+            numDropped.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto& record = records[(size_t) indexes.wrap (indexes.getWriteIndex())];
+        const auto timeStamp = message.getTimeStamp() > 0.0 ? message.getTimeStamp()
+                                                            : Time::getMillisecondCounterHiRes() * 0.001;
+        record.sampleTime = toSampleTime (timeStamp);
+        record.size = (uint8) size;
+        std::copy (message.getRawData(), message.getRawData() + size, record.data);
+
+        indexes.finishedWrite (1);
+    }
+
+    /** Consumer: moves everything that has arrived into a MidiBuffer, positioned within
+        a block of numSamples that ends now. Call this from the audio thread only.
+    */
+    void removeNextBlockOfMessages (MidiBuffer& destination, int numSamples) noexcept
+    {
+        jassert (numSamples > 0);
+
+        const auto blockStart = toSampleTime (Time::getMillisecondCounterHiRes() * 0.001) - numSamples;
+        const auto numReady = indexes.getNumReady();
+        const auto read = indexes.getReadIndex();
+
+        for (auto i = 0; i < numReady; ++i)
+        {
+            const auto& record = records[(size_t) indexes.wrap (read + (uint32) i)];
+
+            // anything from before this block arrived while the last one was being
+            // rendered, so it goes at the start
+            const auto position = (int) jlimit ((int64) 0, (int64) numSamples - 1, record.sampleTime - blockStart);
+            destination.addEvent (record.data, record.size, position);
+        }
+
+        indexes.finishedRead (numReady);
+    }
+
+    /** Returns how many messages were dropped because the queue was full. */
+    int getNumDropped() const noexcept      { return numDropped.load (std::memory_order_relaxed); }
+
+private:
+    struct Record
+    {
+        int64 sampleTime = 0;
+        uint8 data[3] {};
+        uint8 size = 0;
+    };
+
+    int64 toSampleTime (double seconds) const noexcept
+    {
+        return (int64) ((seconds - clockOrigin.load (std::memory_order_relaxed)) * sampleRate.load (std::memory_order_relaxed));
+    }
+
+    std::array<Record, (size_t) capacity> records;
+    SpscIndexPair<capacity> indexes;
+
+    std::atomic<double> sampleRate { 44100.0 }, clockOrigin { 0.0 };
+    std::atomic<int> numDropped { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (MidiInputFifo)
+};
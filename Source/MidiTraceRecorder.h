@@ -0,0 +1,232 @@
+/*
+  ==============================================================================
+
+    This file contains the binary MIDI trace recorder, and the reader that loads
+    its traces back for replay.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SpscIndexPair.h"
+
+//==============================================================================
+/**
+    One MIDI message in a trace, as it's written to disk: the time it arrived, in
+    microseconds since recording started, and the message's bytes. Every record is
+    recordSize bytes long, little-endian.
+*/
+struct MidiTraceRecord
+{
+    static constexpr int recordSize = 16;
+
+    MidiMessage toMessage() const       { return MidiMessage (data, (int) size, (double) microseconds * 1.0e-6); }
+
+    String getDescription() const
+    {
+        return String ((double) microseconds * 1.0e-3, 3) + " ms: " + toMessage().getDescription();
+    }
+
+    void writeTo (OutputStream& stream) const
+    {
+        stream.writeInt64 (microseconds);
+        stream.write (data, 3);
+        stream.writeByte ((char) size);
+        stream.writeInt (0);    // reserved
+    }
+
+    /** Reads the next record, returning false if it isn't a valid one. */
+    bool readFrom (InputStream& stream)
+    {
+        microseconds = stream.readInt64();
+        const auto numRead = stream.read (data, 3);
+        size = (uint8) stream.readByte();
+        stream.readInt();
+
+        return numRead == 3 && size >= 1 && size <= 3;
+    }
+
+    int64 microseconds = 0;
+    uint8 data[3] {};
+    uint8 size = 0;
+};
+
+//==============================================================================
+/**
+    Records the MIDI input to a binary trace file, for replaying through the offline
+    renderer.
+
+    The MIDI thread only copies each message into a fixed-size record in a wait-free
+    ring, so recording can be left on without the device thread ever allocating,
+    formatting a string or touching the disk. A background thread drains the ring
+    into the file, and in debug builds prints each message as it goes. If the ring
+    fills up, messages are dropped and counted rather than blocking the MIDI thread.
+
+    Register it once for all devices; AudioDeviceManager serialises its MIDI callbacks,
+    so the ring only ever has one producer.
+
+    A trace file starts with the 8-byte tag in fileTag, followed by MidiTraceRecords.
+*/
+class MidiTraceRecorder final : public MidiInputCallback,
+                                private TimeSliceClient
+{
+public:
+    static constexpr int capacity = 4096;   // in messages
+    static constexpr const char* fileTag = "SYNTHMT1";
+
+    MidiTraceRecorder() = default;
+
+    ~MidiTraceRecorder() override
+    {
+        stop();
+        thread.stopThread (1000);
+    }
+
+    /** Starts recording into a new file, replacing any trace already being recorded.
+        Call this from the message thread.
+    */
+    Result start (const File& file)
+    {
+        stop();
+
+        file.deleteFile();
+        auto stream = file.createOutputStream();
+
+        if (stream == nullptr)
+            return Result::fail ("Couldn't open " + file.getFullPathName() + " for writing");
+
+        stream->write (fileTag, 8);
+
+        output = std::move (stream);
+        numDropped.store (0, std::memory_order_relaxed);
+        clockOrigin.store (Time::getMillisecondCounterHiRes() * 0.001);
+        indexes.discardAll();
+        recording.store (true, std::memory_order_release);
+
+        thread.addTimeSliceClient (this);
+
+        if (! thread.isThreadRunning())
+            thread.startThread (Thread::Priority::low);
+
+        return Result::ok();
+    }
+
+    /** Stops recording, and writes out whatever is still waiting in the ring. Call
+        this from the message thread.
+    */
+    void stop()
+    {
+        if (! recording.exchange (false))
+            return;
+
+        // this waits for the drain thread to finish its current pass
+        thread.removeTimeSliceClient (this);
+        drain();
+
+        output->flush();
+        output.reset();
+    }
+
+    bool isRecording() const noexcept       { return recording.load (std::memory_order_relaxed); }
+
+    /** Returns how many messages were dropped from the current trace because the ring
+        was full.
+    */
+    int getNumDropped() const noexcept      { return numDropped.load (std::memory_order_relaxed); }
+
+    /** Called on the MIDI thread: copies the message into the ring and nothing more. */
+    void handleIncomingMidiMessage (MidiInput*, const MidiMessage& message) override
+    {
+        const auto size = message.getRawDataSize();
+
+        if (! recording.load (std::memory_order_acquire) || size < 1 || size > 3)
+            return;
+
+        if (indexes.getFreeSpace() == 0)
+        {
+            numDropped.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        const auto timeStamp = message.getTimeStamp() > 0.0 ? message.getTimeStamp()
+                                                            : Time::getMillisecondCounterHiRes() * 0.001;
+
+        auto& record = records[(size_t) indexes.wrap (indexes.getWriteIndex())];
+        record.microseconds = jmax ((int64) 0, (int64) ((timeStamp - clockOrigin.load (std::memory_order_relaxed)) * 1.0e6));
+        record.size = (uint8) size;
+        std::copy (message.getRawData(), message.getRawData() + size, record.data);
+
+        indexes.finishedWrite (1);
+    }
+
+    //==============================================================================
+    /** Reads a trace into a sequence, with timestamps in seconds from the start of the
+        recording, ready to be rendered like a MIDI file.
+    */
+    static Result loadTrace (const File& file, MidiMessageSequence& sequence)
+    {
+        FileInputStream stream (file);
+
+        if (! stream.openedOk())
+            return Result::fail ("Couldn't open " + file.getFullPathName());
+
+        char tag[8] {};
+
+        if (stream.read (tag, 8) != 8 || std::memcmp (tag, fileTag, 8) != 0)
+            return Result::fail (file.getFullPathName() + " is not a MIDI trace");
+
+        MidiTraceRecord record;
+
+        while (stream.getNumBytesRemaining() >= MidiTraceRecord::recordSize)
+        {
+            if (! record.readFrom (stream))
+                return Result::fail (file.getFullPathName() + " has a corrupt record at byte "
+                                       + String (stream.getPosition() - MidiTraceRecord::recordSize));
+
+            sequence.addEvent (record.toMessage());
+        }
+
+        sequence.updateMatchedPairs();
+        return Result::ok();
+    }
+
+private:
+    int useTimeSlice() override
+    {
+        return drain() ? 0 : 20;
+    }
+
+    /** Writes everything in the ring to the file. Returns true if there was anything. */
+    bool drain()
+    {
+        const auto numReady = indexes.getNumReady();
+        const auto read = indexes.getReadIndex();
+
+        if (numReady == 0)
+            return false;
+
+        for (auto i = 0; i < numReady; ++i)
+        {
+            const auto& record = records[(size_t) indexes.wrap (read + (uint32) i)];
+            record.writeTo (*output);
+
+            DBG ("MIDI Received: " << record.getDescription());
+        }
+
+        indexes.finishedRead (numReady);
+        return true;
+    }
+
+    std::array<MidiTraceRecord, (size_t) capacity> records;
+    SpscIndexPair<capacity> indexes;
+
+    std::atomic<bool> recording { false };
+    std::atomic<double> clockOrigin { 0.0 };
+    std::atomic<int> numDropped { 0 };
+
+    TimeSliceThread thread { "MIDI trace" };
+    std::unique_ptr<OutputStream> output;
+
+    JUCE_DECLARE_NON_COPYABLE (MidiTraceRecorder)
+};
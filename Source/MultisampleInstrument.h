@@ -0,0 +1,220 @@
+/*
+  ==============================================================================
+
+    This file contains the multisampled instrument model played by the sampler
+    voices, and its loader.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SampleCache.h"
+
+//==============================================================================
+/** One sample of a multisampled instrument, and the notes and velocities it plays. */
+struct SampleZone
+{
+    const CachedSample* sample = nullptr;
+    int rootNote = 60;
+    int lowNote = 0, highNote = 127;
+    int lowVelocity = 1, highVelocity = 127;
+    float gain = 1.0f;
+};
+
+//==============================================================================
+/**
+    A set of sample zones, each covering a range of notes and a range of velocities,
+    with a flat note-by-velocity table that finds the zone for a note-on in constant
+    time however many zones there are.
+
+    Zones that overlap are played in turn: every distinct set of zones that covers
+    some cell of the table is a round-robin group, with its own position, so repeated
+    notes cycle through the group's zones in the order the manifest lists them.
+
+    An instrument is described by a JSON manifest like this:
+
+    @code
+    {
+      "name": "Upright piano",
+      "headLength": 16384,
+      "zones": [
+        { "sample": "C4-soft-1.wav", "root": 60, "keys": [58, 62], "velocities": [1, 80] },
+        { "sample": "C4-soft-2.wav", "root": 60, "keys": [58, 62], "velocities": [1, 80] },
+        { "sample": "C4-hard.wav",   "root": 60, "keys": [58, 62], "velocities": [81, 127], "gain": -3 }
+      ]
+    }
+    @endcode
+
+    Sample paths are relative to the manifest. Keys and velocities are inclusive
+    ranges that default to everything, and loading fails if one is reversed. Gain
+    is in decibels, and headLength is how many frames of each sample stay in
+    memory, the rest being streamed from disk.
+*/
+class MultisampleInstrument
+{
+public:
+    MultisampleInstrument() = default;
+
+    /** Loads an instrument from a manifest, pulling its samples into a cache, which
+        must outlive the instrument. This reads from disk, so keep it off the audio
+        thread.
+    */
+    Result loadFromManifest (const File& manifest, SampleCache& cache)
+    {
+        var json;
+
+        if (auto result = JSON::parse (manifest.loadFileAsString(), json); result.failed())
+            return Result::fail (manifest.getFileName() + ": " + result.getErrorMessage());
+
+        const auto* zoneList = json["zones"].getArray();
+
+        if (zoneList == nullptr || zoneList->isEmpty())
+            return Result::fail (manifest.getFileName() + ": the manifest has no zones");
+
+        name = json.getProperty ("name", manifest.getFileNameWithoutExtension()).toString();
+        const auto headLength = (int) json.getProperty ("headLength", SampleCache::defaultHeadLength);
+
+        zones.clearQuick();
+        zones.ensureStorageAllocated (zoneList->size());
+
+        for (const auto& zoneDescription : *zoneList)
+        {
+            SampleZone zone;
+            zone.rootNote = jlimit (0, 127, (int) zoneDescription.getProperty ("root", 60));
+            zone.gain = Decibels::decibelsToGain ((float) zoneDescription.getProperty ("gain", 0.0));
+
+            // a reversed range would make a zone that never plays, so treat it as a mistake
+            if (! readRange (zoneDescription["keys"], 0, zone.lowNote, zone.highNote))
+                return Result::fail (manifest.getFileName() + ": zone " + String (zones.size())
+                                       + " has a reversed key range");
+
+            if (! readRange (zoneDescription["velocities"], 1, zone.lowVelocity, zone.highVelocity))
+                return Result::fail (manifest.getFileName() + ": zone " + String (zones.size())
+                                       + " has a reversed velocity range");
+
+            const auto file = manifest.getSiblingFile (zoneDescription["sample"].toString());
+            zone.sample = cache.getStreamedSample (file, headLength);
+
+            if (zone.sample == nullptr)
+                return Result::fail ("Couldn't load " + file.getFullPathName());
+
+            zones.add (zone);
+        }
+
+        if (! buildTable())
+            return Result::fail (manifest.getFileName() + ": too many different sets of overlapping zones");
+
+        return Result::ok();
+    }
+
+    const String& getName() const noexcept      { return name; }
+    int getNumZones() const noexcept            { return zones.size(); }
+
+    /** Returns the zone to play for a note-on, or nullptr if there isn't one, and
+        moves on its round-robin group. Call this from the audio thread only.
+    */
+    const SampleZone* selectZone (int midiNoteNumber, int velocity) noexcept
+    {
+        if (table.empty() || ! isPositiveAndBelow (midiNoteNumber, 128) || ! isPositiveAndBelow (velocity, 128))
+            return nullptr;
+
+        const auto groupIndex = table[(size_t) (midiNoteNumber * 128 + velocity)];
+
+        if (groupIndex == noGroup)
+            return nullptr;
+
+        auto& group = groups[(size_t) groupIndex];
+        const auto zone = groupZones[(size_t) (group.first + group.next)];
+
+        if (++group.next == group.size)
+            group.next = 0;
+
+        return &zones.getReference (zone);
+    }
+
+private:
+    static constexpr uint16 noGroup = 0xffff;
+
+    struct Group
+    {
+        int first = 0, size = 0;    // the group's run of groupZones
+        int next = 0;               // the round-robin position
+    };
+
+    /** Returns false if the range is the wrong way round. */
+    static bool readRange (const var& range, int defaultLow, int& low, int& high)
+    {
+        if (range.isArray() && range.size() == 2)
+        {
+            low  = jlimit (0, 127, (int) range[0]);
+            high = jlimit (0, 127, (int) range[1]);
+            return low <= high;
+        }
+        else if (! range.isVoid())
+        {
+            low = high = jlimit (0, 127, (int) range);
+        }
+        else
+        {
+            low = defaultLow;
+            high = 127;
+        }
+
+        return true;
+    }
+
+    bool buildTable()
+    {
+        // collect the zones covering each cell; zones usually cover small areas of the
+        // table, so this visits far fewer cells than testing every zone for every cell
+        std::vector<std::vector<int>> cellZones (128 * 128);
+
+        for (auto i = 0; i < zones.size(); ++i)
+        {
+            const auto& zone = zones.getReference (i);
+
+            for (auto note = zone.lowNote; note <= zone.highNote; ++note)
+                for (auto velocity = zone.lowVelocity; velocity <= zone.highVelocity; ++velocity)
+                    cellZones[(size_t) (note * 128 + velocity)].push_back (i);
+        }
+
+        // cells covered by the same zones share a group, and so a round-robin position
+        std::map<std::vector<int>, uint16> groupIndexes;
+        groups.clear();
+        groupZones.clear();
+        table.assign (128 * 128, noGroup);
+
+        for (size_t cell = 0; cell < cellZones.size(); ++cell)
+        {
+            const auto& covering = cellZones[cell];
+
+            if (covering.empty())
+                continue;
+
+            if (groups.size() >= noGroup)
+                return false;
+
+            auto [existing, isNew] = groupIndexes.emplace (covering, (uint16) groups.size());
+
+            if (isNew)
+            {
+                groups.push_back ({ (int) groupZones.size(), (int) covering.size(), 0 });
+                groupZones.insert (groupZones.end(), covering.begin(), covering.end());
+            }
+
+            table[cell] = existing->second;
+        }
+
+        return true;
+    }
+
+    String name;
+    Array<SampleZone> zones;
+
+    std::vector<uint16> table;      // the group for each note * 128 + velocity
+    std::vector<Group> groups;
+    std::vector<int> groupZones;
+
+    JUCE_DECLARE_NON_COPYABLE (MultisampleInstrument)
+};
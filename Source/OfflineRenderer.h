@@ -0,0 +1,251 @@
+/*
+  ==============================================================================
+
+    This file contains a headless renderer that drives SynthAudioSource from a
+    MIDI file, without an audio device or any GUI, and measures what it costs.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "AudioSynthesiserDemo.h"
+
+//==============================================================================
+/** Everything needed to describe one offline render. */
+struct OfflineRenderSettings
+{
+    File midiFile;
+    File midiTrace;                 // a recorded MIDI trace to replay instead of the MIDI file
+    File outputFile;                // leave this empty to render without writing a file
+
+    double sampleRate       = 44100.0;
+    int blockSize           = 512;
+    int numChannels         = 2;
+    int numVoicesPerSound   = 16;   // clamped to SynthAudioSource::minNumVoices..maxNumVoices
+    int numRenderThreads    = 0;    // extra threads to render voices on, as well as the calling thread
+    double tailSeconds      = 2.0;  // extra time rendered after the last MIDI event
+
+    bool useSampledSound = false;
+    File streamedSample;            // a WAV or AIFF file to stream instead of the cello
+    int streamedSampleRootNote = 60;
+    File instrumentManifest;        // a multisampled instrument to play instead; takes precedence over the others
+    ResamplingQuality resamplingQuality = ResamplingQuality::high;  // there's time for the best one offline
+    SineWaveVoice::WaveType waveType = SineWaveVoice::Sine;
+    ADSR::Parameters envelope { 0.1f, 0.8f, 0.8f, 0.8f };
+    BlockEnvelope::Curve envelopeCurve = BlockEnvelope::Curve::linear;
+
+    FilterType filterType = FilterType::lowPass;
+    double cutoff    = 1000.0;
+    double resonance = 0.7;
+    float filterDrive = 1.0f;
+    int oversamplingFactor = 1;     // 1, 2, 4 or 8
+    ModulationParameters modulation;
+};
+
+//==============================================================================
+/** The numbers collected while rendering. Block times are in microseconds. */
+struct OfflineRenderStats
+{
+    int64 numSamples = 0;
+    int numBlocks = 0;
+
+    double audioSeconds = 0.0;
+    double renderSeconds = 0.0;
+    double realtimeFactor = 0.0;
+
+    double blockTimeP50 = 0.0, blockTimeP90 = 0.0, blockTimeP99 = 0.0, blockTimeMax = 0.0;
+    int peakVoices = 0;
+    int streamUnderruns = 0;
+    int latencySamples = 0;         // trimmed from the start of the output
+};
+
+//==============================================================================
+/**
+    Renders a MIDI file or trace through SynthAudioSource as fast as the machine allows.
+
+    Only the time spent inside SynthAudioSource::renderNextBlock() is measured, so
+    reading the MIDI file and writing the output don't distort the numbers.
+*/
+class OfflineRenderer
+{
+public:
+    explicit OfflineRenderer (const OfflineRenderSettings& settingsToUse)
+        : settings (settingsToUse)
+    {
+    }
+
+    Result render (OfflineRenderStats& stats)
+    {
+        MidiMessageSequence sequence;
+
+        if (auto result = loadSequence (sequence); result.failed())
+            return result;
+
+        MidiKeyboardState keyboardState;
+        SynthAudioSource source (keyboardState, settings.numVoicesPerSound);
+
+        if (settings.instrumentManifest != File())
+        {
+            if (auto result = source.setUsingInstrument (settings.instrumentManifest); result.failed())
+                return result;
+        }
+        else if (settings.streamedSample != File())
+        {
+            if (! source.setUsingStreamedSample (settings.streamedSample, settings.streamedSampleRootNote))
+                return Result::fail ("Couldn't stream " + settings.streamedSample.getFullPathName());
+        }
+        else if (settings.useSampledSound)
+        {
+            source.setUsingSampledSound();
+        }
+        else
+        {
+            source.setUsingSineWaveSound();
+        }
+
+        // there's no deadline offline, so let the voices wait for the disk
+        source.setNonRealtime (true);
+
+        // these are published before prepareToPlay() picks them up, so the render
+        // starts at the right settings rather than gliding to them
+        source.setWaveType (settings.waveType);
+        source.setEnvelopeParameters (settings.envelope);
+        source.setEnvelopeCurve (settings.envelopeCurve);
+        source.setModulationParameters (settings.modulation);
+        source.setResamplingQuality (settings.resamplingQuality);
+        source.setFilterType (settings.filterType);
+        source.setFilterDrive (settings.filterDrive);
+        source.updateFilterCoefficients (settings.cutoff, settings.resonance);
+        source.setOversamplingFactor (settings.oversamplingFactor);
+        source.setNumRenderThreads (settings.numRenderThreads);
+        source.prepareToPlay (settings.blockSize, settings.sampleRate);
+
+        std::unique_ptr<AudioFormatWriter> writer;
+
+        if (settings.outputFile != File())
+        {
+            settings.outputFile.deleteFile();
+            auto stream = settings.outputFile.createOutputStream();
+
+            if (stream == nullptr)
+                return Result::fail ("Couldn't open " + settings.outputFile.getFullPathName() + " for writing");
+
+            writer.reset (WavAudioFormat().createWriterFor (stream.get(), settings.sampleRate,
+                                                            (unsigned int) settings.numChannels, 24, {}, 0));
+
+            if (writer == nullptr)
+                return Result::fail ("Couldn't create a WAV writer for " + settings.outputFile.getFullPathName());
+
+            stream.release(); // the writer owns the stream now
+        }
+
+        // the oversampler delays the output, so that much more is rendered and the
+        // start is left out of the file, which keeps it lined up with the MIDI
+        stats.latencySamples = source.getLatencyInSamples();
+
+        const auto endTime = sequence.getEndTime() + settings.tailSeconds;
+        const auto totalSamples = (int64) std::ceil (endTime * settings.sampleRate) + stats.latencySamples;
+        const auto numBlocks = (int) ((totalSamples + settings.blockSize - 1) / settings.blockSize);
+
+        AudioBuffer<float> buffer (settings.numChannels, settings.blockSize);
+        MidiBuffer midi;
+        midi.ensureSize (4096);
+
+        std::vector<double> blockTimes;
+        blockTimes.reserve ((size_t) numBlocks);
+
+        const auto ticksPerMicrosecond = (double) Time::getHighResolutionTicksPerSecond() / 1.0e6;
+        auto nextEvent = 0;
+        int64 totalTicks = 0;
+
+        for (int64 blockStart = 0; blockStart < totalSamples; blockStart += settings.blockSize)
+        {
+            const auto numSamples = (int) jmin ((int64) settings.blockSize, totalSamples - blockStart);
+            const auto blockEndTime = (double) (blockStart + numSamples) / settings.sampleRate;
+
+            midi.clear();
+
+            for (; nextEvent < sequence.getNumEvents(); ++nextEvent)
+            {
+                const auto& message = sequence.getEventPointer (nextEvent)->message;
+
+                if (message.getTimeStamp() >= blockEndTime)
+                    break;
+
+                const auto position = (int) (message.getTimeStamp() * settings.sampleRate) - (int) blockStart;
+                midi.addEvent (message, jlimit (0, numSamples - 1, position));
+            }
+
+            buffer.clear();
+
+            const auto startTicks = Time::getHighResolutionTicks();
+            source.renderNextBlock (buffer, midi, 0, numSamples);
+            const auto elapsedTicks = Time::getHighResolutionTicks() - startTicks;
+
+            totalTicks += elapsedTicks;
+            blockTimes.push_back ((double) elapsedTicks / ticksPerMicrosecond);
+            stats.peakVoices = jmax (stats.peakVoices, source.getNumActiveVoices());
+
+            if (writer != nullptr)
+            {
+                const auto numToSkip = (int) jlimit ((int64) 0, (int64) numSamples, stats.latencySamples - blockStart);
+                writer->writeFromAudioSampleBuffer (buffer, numToSkip, numSamples - numToSkip);
+            }
+        }
+
+        stats.numSamples = totalSamples;
+        stats.streamUnderruns = source.getNumStreamUnderruns();
+        stats.numBlocks = (int) blockTimes.size();
+        stats.audioSeconds = (double) totalSamples / settings.sampleRate;
+        stats.renderSeconds = Time::highResolutionTicksToSeconds (totalTicks);
+        stats.realtimeFactor = stats.renderSeconds > 0.0 ? stats.audioSeconds / stats.renderSeconds : 0.0;
+
+        if (! blockTimes.empty())
+        {
+            std::sort (blockTimes.begin(), blockTimes.end());
+
+            auto percentile = [&blockTimes] (double p)
+            {
+                const auto index = (size_t) std::ceil (p * (double) blockTimes.size()) - 1;
+                return blockTimes[jlimit ((size_t) 0, blockTimes.size() - 1, index)];
+            };
+
+            stats.blockTimeP50 = percentile (0.50);
+            stats.blockTimeP90 = percentile (0.90);
+            stats.blockTimeP99 = percentile (0.99);
+            stats.blockTimeMax = blockTimes.back();
+        }
+
+        return Result::ok();
+    }
+
+private:
+    Result loadSequence (MidiMessageSequence& sequence) const
+    {
+        if (settings.midiTrace != File())
+            return MidiTraceRecorder::loadTrace (settings.midiTrace, sequence);
+
+        FileInputStream stream (settings.midiFile);
+
+        if (! stream.openedOk())
+            return Result::fail ("Couldn't open " + settings.midiFile.getFullPathName());
+
+        MidiFile midiFile;
+
+        if (! midiFile.readFrom (stream))
+            return Result::fail (settings.midiFile.getFullPathName() + " is not a valid MIDI file");
+
+        midiFile.convertTimestampTicksToSeconds();
+
+        for (auto i = 0; i < midiFile.getNumTracks(); ++i)
+            sequence.addSequence (*midiFile.getTrack (i), 0.0);
+
+        sequence.sort();
+        return Result::ok();
+    }
+
+    OfflineRenderSettings settings;
+
+    JUCE_DECLARE_NON_COPYABLE (OfflineRenderer)
+};
@@ -0,0 +1,174 @@
+/*
+  ==============================================================================
+
+    This file contains the vectorised inner loops used to render the oscillators.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "WavetableBank.h"
+
+#if defined (__AVX2__)
+ #define SYNTH_OSCILLATOR_USE_AVX2 1
+ #include <immintrin.h>
+#elif defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+ #define SYNTH_OSCILLATOR_USE_SSE2 1
+ #include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+ #define SYNTH_OSCILLATOR_USE_NEON 1
+ #include <arm_neon.h>
+#endif
+
+//==============================================================================
+/**
+    Block kernels for the oscillators.
+
+    Each kernel fills a whole contiguous block, so the waveform is chosen once per
+    block by the caller rather than once per sample. The phase accumulation, the
+    table index calculation and the interpolation run several lanes at a time; only
+    the table reads themselves are scalar, except on AVX2 which has a gather.
+*/
+namespace OscillatorKernels
+{
+    /** Reads a WavetableBank table into dest, advancing phase (in cycles, [0, 1)) by
+        phaseDelta per sample. The phase is left ready for the next block.
+
+        For a glide, phaseDelta is the first sample's increment, and each one after that
+        is phaseDeltaStep bigger than the last. The caller must keep every increment in
+        [0, 1).
+    */
+    inline void renderWavetable (const float* table, float* dest, int numSamples,
+                                 float& phase, float phaseDelta, float phaseDeltaStep = 0.0f) noexcept
+    {
+        jassert (phaseDelta >= 0.0f && phaseDelta < 1.0f);
+        jassert (numSamples <= 0 || isPositiveAndBelow (phaseDelta + phaseDeltaStep * (float) (numSamples - 1), 1.0f));
+
+        auto i = 0;
+
+        // each lane runs a few samples apart, so while gliding, a lane moves on by that
+        // many of its own increments, plus the triangular number of steps they grow by
+
+       #if SYNTH_OSCILLATOR_USE_AVX2
+        if (numSamples >= 8)
+        {
+            const auto size = _mm256_set1_ps ((float) WavetableBank::tableSize);
+            const auto lanes = _mm256_setr_ps (0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+            const auto growth = _mm256_set1_ps (8.0f * phaseDeltaStep);
+            const auto glide = _mm256_set1_ps (28.0f * phaseDeltaStep);
+            auto deltas = _mm256_add_ps (_mm256_set1_ps (phaseDelta), _mm256_mul_ps (_mm256_set1_ps (phaseDeltaStep), lanes));
+            auto phases = _mm256_add_ps (_mm256_set1_ps (phase),
+                                         _mm256_add_ps (_mm256_mul_ps (_mm256_set1_ps (phaseDelta), lanes),
+                                                        _mm256_mul_ps (_mm256_set1_ps (phaseDeltaStep),
+                                                                       _mm256_setr_ps (0.0f, 0.0f, 1.0f, 3.0f, 6.0f, 10.0f, 15.0f, 21.0f))));
+            phases = _mm256_sub_ps (phases, _mm256_floor_ps (phases));
+
+            for (; i + 8 <= numSamples; i += 8)
+            {
+                const auto positions = _mm256_mul_ps (phases, size);
+                const auto indices   = _mm256_cvttps_epi32 (positions);
+                const auto fractions = _mm256_sub_ps (positions, _mm256_cvtepi32_ps (indices));
+                const auto a = _mm256_i32gather_ps (table,     indices, 4);
+                const auto b = _mm256_i32gather_ps (table + 1, indices, 4);
+
+                _mm256_storeu_ps (dest + i, _mm256_add_ps (a, _mm256_mul_ps (fractions, _mm256_sub_ps (b, a))));
+
+                phases = _mm256_add_ps (phases, _mm256_add_ps (_mm256_mul_ps (deltas, _mm256_set1_ps (8.0f)), glide));
+                phases = _mm256_sub_ps (phases, _mm256_floor_ps (phases));
+                deltas = _mm256_add_ps (deltas, growth);
+            }
+
+            phase = _mm256_cvtss_f32 (phases);
+            phaseDelta = _mm256_cvtss_f32 (deltas);
+        }
+       #elif SYNTH_OSCILLATOR_USE_SSE2
+        if (numSamples >= 4)
+        {
+            const auto size = _mm_set1_ps ((float) WavetableBank::tableSize);
+            const auto growth = _mm_set1_ps (4.0f * phaseDeltaStep);
+            const auto glide = _mm_set1_ps (6.0f * phaseDeltaStep);
+            auto deltas = _mm_setr_ps (phaseDelta, phaseDelta + phaseDeltaStep, phaseDelta + 2.0f * phaseDeltaStep, phaseDelta + 3.0f * phaseDeltaStep);
+            auto phases = _mm_setr_ps (phase,
+                                       phase + phaseDelta,
+                                       phase + 2.0f * phaseDelta + phaseDeltaStep,
+                                       phase + 3.0f * phaseDelta + 3.0f * phaseDeltaStep);
+
+            // the phases are never negative, so truncating is the same as flooring
+            phases = _mm_sub_ps (phases, _mm_cvtepi32_ps (_mm_cvttps_epi32 (phases)));
+
+            alignas (16) int32 indices[4];
+
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                const auto positions = _mm_mul_ps (phases, size);
+                const auto whole     = _mm_cvttps_epi32 (positions);
+                const auto fractions = _mm_sub_ps (positions, _mm_cvtepi32_ps (whole));
+                _mm_store_si128 ((__m128i*) indices, whole);
+
+                const auto a = _mm_setr_ps (table[indices[0]],     table[indices[1]],     table[indices[2]],     table[indices[3]]);
+                const auto b = _mm_setr_ps (table[indices[0] + 1], table[indices[1] + 1], table[indices[2] + 1], table[indices[3] + 1]);
+
+                _mm_storeu_ps (dest + i, _mm_add_ps (a, _mm_mul_ps (fractions, _mm_sub_ps (b, a))));
+
+                phases = _mm_add_ps (phases, _mm_add_ps (_mm_mul_ps (deltas, _mm_set1_ps (4.0f)), glide));
+                phases = _mm_sub_ps (phases, _mm_cvtepi32_ps (_mm_cvttps_epi32 (phases)));
+                deltas = _mm_add_ps (deltas, growth);
+            }
+
+            phase = _mm_cvtss_f32 (phases);
+            phaseDelta = _mm_cvtss_f32 (deltas);
+        }
+       #elif SYNTH_OSCILLATOR_USE_NEON
+        if (numSamples >= 4)
+        {
+            const auto size = vdupq_n_f32 ((float) WavetableBank::tableSize);
+            const auto growth = vdupq_n_f32 (4.0f * phaseDeltaStep);
+            const auto glide = vdupq_n_f32 (6.0f * phaseDeltaStep);
+            const float initialDeltas[] = { phaseDelta, phaseDelta + phaseDeltaStep, phaseDelta + 2.0f * phaseDeltaStep, phaseDelta + 3.0f * phaseDeltaStep };
+            const float initial[] = { phase,
+                                      phase + phaseDelta,
+                                      phase + 2.0f * phaseDelta + phaseDeltaStep,
+                                      phase + 3.0f * phaseDelta + 3.0f * phaseDeltaStep };
+            auto deltas = vld1q_f32 (initialDeltas);
+            auto phases = vld1q_f32 (initial);
+            phases = vsubq_f32 (phases, vcvtq_f32_s32 (vcvtq_s32_f32 (phases)));
+
+            int32_t indices[4];
+
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                const auto positions = vmulq_f32 (phases, size);
+                const auto whole     = vcvtq_s32_f32 (positions);
+                const auto fractions = vsubq_f32 (positions, vcvtq_f32_s32 (whole));
+                vst1q_s32 (indices, whole);
+
+                const float aValues[] = { table[indices[0]],     table[indices[1]],     table[indices[2]],     table[indices[3]] };
+                const float bValues[] = { table[indices[0] + 1], table[indices[1] + 1], table[indices[2] + 1], table[indices[3] + 1] };
+                const auto a = vld1q_f32 (aValues);
+                const auto b = vld1q_f32 (bValues);
+
+                vst1q_f32 (dest + i, vmlaq_f32 (a, fractions, vsubq_f32 (b, a)));
+
+                phases = vaddq_f32 (phases, vmlaq_n_f32 (glide, deltas, 4.0f));
+                phases = vsubq_f32 (phases, vcvtq_f32_s32 (vcvtq_s32_f32 (phases)));
+                deltas = vaddq_f32 (deltas, growth);
+            }
+
+            phase = vgetq_lane_f32 (phases, 0);
+            phaseDelta = vgetq_lane_f32 (deltas, 0);
+        }
+       #endif
+
+        for (; i < numSamples; ++i)
+        {
+            dest[i] = WavetableBank::lookup (table, phase);
+
+            phase += phaseDelta;
+            phaseDelta += phaseDeltaStep;
+
+            if (phase >= 1.0f)
+                phase -= 1.0f;
+        }
+    }
+}
@@ -0,0 +1,284 @@
+/*
+  ==============================================================================
+
+    This file contains the half-band decimators that bring the oversampled voice
+    mix back down to the device rate.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "OscillatorKernels.h"   // for the SYNTH_OSCILLATOR_USE_* instruction set checks
+
+//==============================================================================
+/**
+    Halves the sample rate of a few channels with a linear-phase half-band FIR.
+
+    Every other tap of a half-band filter is zero, apart from the centre one, which
+    is exactly 0.5. Split into its two polyphase branches, the odd input samples
+    only ever meet that centre tap, so they're just delayed and halved, and the even
+    ones go through the remaining 2 * numPairs taps at the output rate. Those taps
+    are symmetric, so each pair of samples is added before it's multiplied.
+
+    The convolution runs several outputs at a time, with one coefficient broadcast
+    across a register and the even samples read straight from the branch's history,
+    so there's no shuffling.
+
+    The taps are a Kaiser-windowed sinc, designed when the decimator is prepared.
+*/
+class HalfBandDecimator
+{
+public:
+    HalfBandDecimator() = default;
+
+    /** Designs the filter and allocates the history. A longer filter has a steeper
+        cutoff, more latency and costs more.
+    */
+    void prepare (int newNumPairs, int numChannels, int maximumOutputSize)
+    {
+        numPairs = newNumPairs;
+        maxOutputSize = maximumOutputSize;
+        evenHistory = 2 * numPairs - 1;
+        oddHistory = numPairs;
+
+        designTaps();
+
+        even.assign ((size_t) numChannels, std::vector<float> ((size_t) (evenHistory + maxOutputSize), 0.0f));
+        odd .assign ((size_t) numChannels, std::vector<float> ((size_t) (oddHistory  + maxOutputSize), 0.0f));
+    }
+
+    void reset() noexcept
+    {
+        for (auto& branch : even)   std::fill (branch.begin(), branch.end(), 0.0f);
+        for (auto& branch : odd)    std::fill (branch.begin(), branch.end(), 0.0f);
+    }
+
+    /** Returns the filter's delay, in samples at the input rate. */
+    int getLatencyInInputSamples() const noexcept   { return 2 * numPairs - 1; }
+
+    /** Reads 2 * numOutputSamples samples from source and writes numOutputSamples to dest. */
+    void process (int channel, const float* source, float* dest, int numOutputSamples) noexcept
+    {
+        jassert (numOutputSamples <= maxOutputSize);
+
+        auto* e = even[(size_t) channel].data();
+        auto* o = odd [(size_t) channel].data();
+
+        for (auto i = 0; i < numOutputSamples; ++i)
+        {
+            e[evenHistory + i] = source[2 * i];
+            o[oddHistory + i]  = source[2 * i + 1];
+        }
+
+        convolve (e, o, dest, numOutputSamples);
+
+        std::copy (e + numOutputSamples, e + numOutputSamples + evenHistory, e);
+        std::copy (o + numOutputSamples, o + numOutputSamples + oddHistory, o);
+    }
+
+private:
+    /** dest[n] = 0.5 * odd[n] + the sum over j of taps[j] * (even[n + j] + even[n + 2 * numPairs - 1 - j]) */
+    void convolve (const float* e, const float* o, float* dest, int numSamples) const noexcept
+    {
+        const auto* t = taps.data();
+        const auto last = 2 * numPairs - 1;
+        auto n = 0;
+
+       #if SYNTH_OSCILLATOR_USE_AVX2
+        for (; n + 8 <= numSamples; n += 8)
+        {
+            auto sum = _mm256_mul_ps (_mm256_set1_ps (0.5f), _mm256_loadu_ps (o + n));
+
+            for (auto j = 0; j < numPairs; ++j)
+                sum = _mm256_add_ps (sum, _mm256_mul_ps (_mm256_set1_ps (t[j]),
+                                                         _mm256_add_ps (_mm256_loadu_ps (e + n + j), _mm256_loadu_ps (e + n + last - j))));
+
+            _mm256_storeu_ps (dest + n, sum);
+        }
+       #elif SYNTH_OSCILLATOR_USE_SSE2
+        for (; n + 4 <= numSamples; n += 4)
+        {
+            auto sum = _mm_mul_ps (_mm_set1_ps (0.5f), _mm_loadu_ps (o + n));
+
+            for (auto j = 0; j < numPairs; ++j)
+                sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (t[j]),
+                                                   _mm_add_ps (_mm_loadu_ps (e + n + j), _mm_loadu_ps (e + n + last - j))));
+
+            _mm_storeu_ps (dest + n, sum);
+        }
+       #elif SYNTH_OSCILLATOR_USE_NEON
+        for (; n + 4 <= numSamples; n += 4)
+        {
+            auto sum = vmulq_n_f32 (vld1q_f32 (o + n), 0.5f);
+
+            for (auto j = 0; j < numPairs; ++j)
+                sum = vmlaq_n_f32 (sum, vaddq_f32 (vld1q_f32 (e + n + j), vld1q_f32 (e + n + last - j)), t[j]);
+
+            vst1q_f32 (dest + n, sum);
+        }
+       #endif
+
+        for (; n < numSamples; ++n)
+        {
+            auto sum = 0.5f * o[n];
+
+            for (auto j = 0; j < numPairs; ++j)
+                sum += t[j] * (e[n + j] + e[n + last - j]);
+
+            dest[n] = sum;
+        }
+    }
+
+    void designTaps()
+    {
+        // a Kaiser window with this beta keeps the stopband about 90 dB down
+        constexpr auto beta = 9.0;
+        const auto halfLength = (double) (2 * numPairs);
+
+        auto besselI0 = [] (double x)
+        {
+            auto sum = 1.0, term = 1.0;
+
+            for (auto k = 1; k < 32; ++k)
+            {
+                term *= (x * 0.5 / k) * (x * 0.5 / k);
+                sum += term;
+            }
+
+            return sum;
+        };
+
+        taps.resize ((size_t) numPairs);
+        auto total = 0.0;
+
+        // tap j is (2 * numPairs - 1 - 2 * j) samples from the centre, counting in input samples
+        for (auto j = 0; j < numPairs; ++j)
+        {
+            const auto distance = (double) (2 * numPairs - 1 - 2 * j);
+            const auto sinc = std::sin (MathConstants<double>::halfPi * distance) / (MathConstants<double>::pi * distance);
+            const auto ratio = distance / halfLength;
+            const auto window = besselI0 (beta * std::sqrt (1.0 - ratio * ratio)) / besselI0 (beta);
+
+            taps[(size_t) j] = (float) (sinc * window);
+            total += 2.0 * sinc * window;
+        }
+
+        // the centre tap is 0.5, so the rest are scaled to make the DC gain exactly 1
+        for (auto& tap : taps)
+            tap = (float) (tap * 0.5 / total);
+    }
+
+    int numPairs = 0, maxOutputSize = 0, evenHistory = 0, oddHistory = 0;
+    std::vector<float> taps;
+    std::vector<std::vector<float>> even, odd;
+
+    JUCE_DECLARE_NON_COPYABLE (HalfBandDecimator)
+};
+
+//==============================================================================
+/**
+    Brings a mix rendered at 2, 4 or 8 times the device rate back down to it, with a
+    cascade of half-band decimators.
+
+    The voices generate their samples at the higher rate to begin with, so there's
+    no upsampling stage: only the way down needs filtering. The last stage does the
+    real work of keeping the audio band clean, so it gets the long filter. The
+    earlier ones only have to stop what would alias into the part of the spectrum
+    the last stage then removes, so they're much shorter.
+*/
+class Oversampler
+{
+public:
+    static constexpr int maxFactor = 8;
+
+    Oversampler() = default;
+
+    /** Sets the factor, which is 1, 2, 4 or 8, and allocates the stages. The maximum
+        block size is at the device rate.
+    */
+    void prepare (int newFactor, int numChannels, int maximumBlockSize)
+    {
+        jassert (newFactor == 1 || newFactor == 2 || newFactor == 4 || newFactor == 8);
+
+        factor = newFactor;
+        stages.clear();
+        buffers.clear();
+
+        for (auto rate = factor; rate > 1; rate /= 2)
+        {
+            const auto isLast = rate == 2;
+            const auto outputSize = maximumBlockSize * rate / 2;
+
+            auto stage = std::make_unique<HalfBandDecimator>();
+            stage->prepare (isLast ? lastStageNumPairs : earlyStageNumPairs, numChannels, outputSize);
+            stages.push_back (std::move (stage));
+            buffers.emplace_back (numChannels, outputSize);
+        }
+    }
+
+    void reset() noexcept
+    {
+        for (auto& stage : stages)
+            stage->reset();
+    }
+
+    int getFactor() const noexcept      { return factor; }
+
+    /** Returns the delay the filters add, in samples at the device rate. It isn't a
+        whole number of samples.
+    */
+    double getLatencyInSamples() const noexcept
+    {
+        auto latency = 0.0;
+        auto rate = factor;
+
+        for (auto& stage : stages)
+        {
+            latency += (double) stage->getLatencyInInputSamples() / rate;
+            rate /= 2;
+        }
+
+        return latency;
+    }
+
+    /** Decimates numSamples * getFactor() samples from the start of source, and adds
+        the result to dest at destStartSample.
+    */
+    void processDown (const AudioBuffer<float>& source, AudioBuffer<float>& dest, int destStartSample, int numSamples) noexcept
+    {
+        const auto numChannels = jmin (source.getNumChannels(), dest.getNumChannels());
+
+        if (stages.empty())
+        {
+            for (auto channel = 0; channel < numChannels; ++channel)
+                dest.addFrom (channel, destStartSample, source, channel, 0, numSamples);
+
+            return;
+        }
+
+        const auto* input = &source;
+        auto numOutput = numSamples * factor / 2;
+
+        for (size_t i = 0; i < stages.size(); ++i)
+        {
+            for (auto channel = 0; channel < numChannels; ++channel)
+                stages[i]->process (channel, input->getReadPointer (channel), buffers[i].getWritePointer (channel), numOutput);
+
+            input = &buffers[i];
+            numOutput /= 2;
+        }
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+            dest.addFrom (channel, destStartSample, *input, channel, 0, numSamples);
+    }
+
+private:
+    static constexpr int earlyStageNumPairs = 8, lastStageNumPairs = 16;
+
+    int factor = 1;
+    std::vector<std::unique_ptr<HalfBandDecimator>> stages;
+    std::vector<AudioBuffer<float>> buffers;
+
+    JUCE_DECLARE_NON_COPYABLE (Oversampler)
+};
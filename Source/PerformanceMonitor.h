@@ -0,0 +1,370 @@
+/*
+  ==============================================================================
+
+    This file contains the timing instrumentation for the audio callback, and
+    the overlay that shows it in the demo.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SpscIndexPair.h"
+
+//==============================================================================
+/**
+    Measures where the audio callback's time goes, without locking or allocating.
+
+    The audio thread brackets each callback with beginBlock() and endBlock(), and
+    the work inside it with ScopedStages. That fills in one BlockRecord per block:
+    the callback's total time, the time spent in each stage and how many voices
+    were playing. endBlock() pushes the record into a single-producer,
+    single-consumer ring, and counts an overrun if the callback took longer than
+    the audio it produced.
+
+    The message thread calls update() now and then, which takes the records out of
+    the ring and works out the load, the worst block and the per-stage times over
+    the last second of audio. createReport() writes all that, along with the
+    records themselves, as JSON.
+
+    The times are high-resolution ticks, so they're wall-clock time spent on the
+    audio thread, including any time it was preempted. Outside a block, e.g. when
+    the offline renderer drives the synth directly, a ScopedStage doesn't even read
+    the clock.
+*/
+class PerformanceMonitor
+{
+public:
+    enum Stage
+    {
+        midiInput,      // the MIDI input FIFO and the keyboard state
+        voices,         // the synth's voices, including any render threads
+        filters,        // the voices' filter bank
+        oversampling,   // the decimators, when the voices are oversampled
+        volume,         // the output gain
+        displayTap,     // the copy into the scope's ring
+        numStages
+    };
+
+    static const char* getStageName (int stage) noexcept
+    {
+        static constexpr const char* names[] = { "midi", "voices", "filters", "oversampling", "volume", "display" };
+        static_assert (std::size (names) == numStages, "Every stage needs a name");
+        return names[stage];
+    }
+
+    /** What the audio thread measured in one callback. */
+    struct BlockRecord
+    {
+        int64 startTicks = 0, totalTicks = 0;
+        std::array<int64, numStages> stageTicks {};
+        int numSamples = 0, numActiveVoices = 0;
+    };
+
+    /** The statistics over the last second of audio. Times are in microseconds. */
+    struct Summary
+    {
+        double sampleRate = 0.0;
+        int blockSize = 0, numBlocks = 0;
+        double load = 0.0, peakLoad = 0.0;     // the callback's time over the audio's duration
+        double meanBlockTime = 0.0, worstBlockTime = 0.0, blockBudget = 0.0;
+        std::array<double, numStages> meanStageTime {}, worstStageTime {};
+        int numActiveVoices = 0, peakActiveVoices = 0;
+        int numOverruns = 0;                // since the device started, as seen by the monitor
+        int deviceXRuns = -1;               // as reported by the device, or -1 if it can't tell
+        int numDroppedRecords = 0;
+    };
+
+    PerformanceMonitor() = default;
+
+    //==============================================================================
+    /** Call this before the audio callback starts, e.g. from audioDeviceAboutToStart(). */
+    void prepare (double newSampleRate) noexcept
+    {
+        sampleRate.store (newSampleRate, std::memory_order_relaxed);
+        ticksPerSample = (double) Time::getHighResolutionTicksPerSecond() / jmax (1.0, newSampleRate);
+        numOverruns.store (0, std::memory_order_relaxed);
+    }
+
+    /** Audio thread: starts measuring a callback. */
+    void beginBlock (int numSamples) noexcept
+    {
+        current = {};
+        current.numSamples = numSamples;
+        current.startTicks = Time::getHighResolutionTicks();
+        measuring = true;
+    }
+
+    /** Audio thread: the number of voices playing in this block. */
+    void setNumActiveVoices (int numActive) noexcept    { current.numActiveVoices = numActive; }
+
+    /** Audio thread: true between beginBlock() and endBlock(). */
+    bool isMeasuring() const noexcept                   { return measuring; }
+
+    /** Audio thread: finishes the callback's record and hands it to the message thread. */
+    void endBlock() noexcept
+    {
+        if (! measuring)
+            return;
+
+        measuring = false;
+        current.totalTicks = Time::getHighResolutionTicks() - current.startTicks;
+
+        if ((double) current.totalTicks > ticksPerSample * current.numSamples)
+            numOverruns.fetch_add (1, std::memory_order_relaxed);
+
+        if (indexes.getFreeSpace() == 0)
+        {
+            numDropped.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        records[(size_t) indexes.wrap (indexes.getWriteIndex())] = current;
+        indexes.finishedWrite (1);
+    }
+
+    /** Adds the time from its construction to its destruction to a stage of the current
+        block. Stages can be entered several times in a block, but shouldn't be nested.
+    */
+    class ScopedStage
+    {
+    public:
+        ScopedStage (PerformanceMonitor& monitorIn, Stage stageIn) noexcept
+            : monitor (monitorIn.measuring ? &monitorIn : nullptr),
+              stage (stageIn),
+              startTicks (monitor != nullptr ? Time::getHighResolutionTicks() : 0)
+        {
+        }
+
+        ~ScopedStage() noexcept
+        {
+            if (monitor != nullptr)
+                monitor->current.stageTicks[(size_t) stage] += Time::getHighResolutionTicks() - startTicks;
+        }
+
+    private:
+        PerformanceMonitor* monitor;
+        Stage stage;
+        int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedStage)
+    };
+
+    //==============================================================================
+    /** Message thread: takes the new records out of the ring and updates the summary.
+        Pass in the device's own xrun count if it has one.
+    */
+    const Summary& update (int deviceXRunCount = -1)
+    {
+        const auto numReady = indexes.getNumReady();
+        const auto read = indexes.getReadIndex();
+
+        for (auto i = 0; i < numReady; ++i)
+        {
+            recent.push_back (records[(size_t) indexes.wrap (read + (uint32) i)]);
+            recentSamples += recent.back().numSamples;
+        }
+
+        indexes.finishedRead (numReady);
+
+        const auto rate = sampleRate.load (std::memory_order_relaxed);
+
+        // keep one second of audio, but always at least the last block
+        while (recent.size() > 1 && recentSamples - recent.front().numSamples >= rate * windowSeconds)
+        {
+            recentSamples -= recent.front().numSamples;
+            recent.pop_front();
+        }
+
+        summary = {};
+        summary.sampleRate = rate;
+        summary.numBlocks = (int) recent.size();
+        summary.numOverruns = numOverruns.load (std::memory_order_relaxed);
+        summary.deviceXRuns = deviceXRunCount;
+        summary.numDroppedRecords = numDropped.load (std::memory_order_relaxed);
+
+        if (recent.empty() || rate <= 0.0)
+            return summary;
+
+        const auto microsecondsPerTick = 1.0e6 / (double) Time::getHighResolutionTicksPerSecond();
+        int64 totalTicks = 0;
+        std::array<int64, numStages> totalStageTicks {};
+
+        for (const auto& record : recent)
+        {
+            const auto blockTime = (double) record.totalTicks * microsecondsPerTick;
+            const auto duration = 1.0e6 * record.numSamples / rate;
+
+            totalTicks += record.totalTicks;
+            summary.worstBlockTime = jmax (summary.worstBlockTime, blockTime);
+            summary.peakLoad = jmax (summary.peakLoad, blockTime / duration);
+            summary.peakActiveVoices = jmax (summary.peakActiveVoices, record.numActiveVoices);
+
+            for (size_t stage = 0; stage < numStages; ++stage)
+            {
+                totalStageTicks[stage] += record.stageTicks[stage];
+                summary.worstStageTime[stage] = jmax (summary.worstStageTime[stage], (double) record.stageTicks[stage] * microsecondsPerTick);
+            }
+        }
+
+        const auto& last = recent.back();
+        summary.blockSize = last.numSamples;
+        summary.blockBudget = 1.0e6 * last.numSamples / rate;
+        summary.numActiveVoices = last.numActiveVoices;
+        summary.load = (double) totalTicks * microsecondsPerTick / (1.0e6 * (double) recentSamples / rate);
+        summary.meanBlockTime = (double) totalTicks * microsecondsPerTick / (double) recent.size();
+
+        for (size_t stage = 0; stage < numStages; ++stage)
+            summary.meanStageTime[stage] = (double) totalStageTicks[stage] * microsecondsPerTick / (double) recent.size();
+
+        return summary;
+    }
+
+    const Summary& getSummary() const noexcept      { return summary; }
+
+    /** Message thread: returns the summary from the last update(), and every block it
+        covers, as JSON.
+    */
+    String createReport() const
+    {
+        const auto microsecondsPerTick = 1.0e6 / (double) Time::getHighResolutionTicksPerSecond();
+
+        auto makeStageObject = [] (const auto& times, double scale)
+        {
+            auto* stages = new DynamicObject();
+
+            for (auto stage = 0; stage < numStages; ++stage)
+                stages->setProperty (getStageName (stage), (double) times[(size_t) stage] * scale);
+
+            return var (stages);
+        };
+
+        auto* report = new DynamicObject();
+        report->setProperty ("sample_rate", summary.sampleRate);
+        report->setProperty ("block_size", summary.blockSize);
+        report->setProperty ("blocks", summary.numBlocks);
+        report->setProperty ("load", summary.load);
+        report->setProperty ("peak_load", summary.peakLoad);
+        report->setProperty ("mean_block_us", summary.meanBlockTime);
+        report->setProperty ("worst_block_us", summary.worstBlockTime);
+        report->setProperty ("block_budget_us", summary.blockBudget);
+        report->setProperty ("mean_stage_us", makeStageObject (summary.meanStageTime, 1.0));
+        report->setProperty ("worst_stage_us", makeStageObject (summary.worstStageTime, 1.0));
+        report->setProperty ("active_voices", summary.numActiveVoices);
+        report->setProperty ("peak_active_voices", summary.peakActiveVoices);
+        report->setProperty ("overruns", summary.numOverruns);
+        report->setProperty ("device_xruns", summary.deviceXRuns);
+        report->setProperty ("dropped_records", summary.numDroppedRecords);
+
+        Array<var> blocks;
+
+        for (const auto& record : recent)
+        {
+            auto* block = new DynamicObject();
+            block->setProperty ("start_us", (double) (record.startTicks - recent.front().startTicks) * microsecondsPerTick);
+            block->setProperty ("samples", record.numSamples);
+            block->setProperty ("total_us", (double) record.totalTicks * microsecondsPerTick);
+            block->setProperty ("stages_us", makeStageObject (record.stageTicks, microsecondsPerTick));
+            block->setProperty ("voices", record.numActiveVoices);
+            blocks.add (var (block));
+        }
+
+        report->setProperty ("block_records", blocks);
+        return JSON::toString (var (report));
+    }
+
+private:
+    static constexpr int capacity = 4096;   // records, which is over a second of 16-sample blocks
+    static constexpr double windowSeconds = 1.0;
+
+    // only touched by the audio thread
+    BlockRecord current;
+    bool measuring = false;
+    double ticksPerSample = 0.0;
+
+    std::array<BlockRecord, (size_t) capacity> records;
+    SpscIndexPair<capacity> indexes;
+    std::atomic<int> numDropped { 0 }, numOverruns { 0 };
+    std::atomic<double> sampleRate { 0.0 };
+
+    // only touched by the message thread
+    std::deque<BlockRecord> recent;
+    int64 recentSamples = 0;
+    Summary summary;
+
+    JUCE_DECLARE_NON_COPYABLE (PerformanceMonitor)
+};
+
+//==============================================================================
+/**
+    A one-line readout of a PerformanceMonitor, updated a few times a second.
+    Clicking it saves a full report as JSON in the user's documents folder.
+*/
+class PerformanceOverlay final : public Component,
+                                 private Timer
+{
+public:
+    PerformanceOverlay (PerformanceMonitor& monitorIn, AudioDeviceManager& deviceManagerIn)
+        : monitor (monitorIn), deviceManager (deviceManagerIn)
+    {
+        setOpaque (true);
+        startTimerHz (4);
+    }
+
+    void paint (Graphics& g) override
+    {
+        g.fillAll (Colours::black);
+        g.setColour (textColour);
+        g.setFont (FontOptions (12.0f));
+        g.drawFittedText (text, getLocalBounds().reduced (4, 0), Justification::centredLeft, 1);
+    }
+
+    void mouseDown (const MouseEvent&) override
+    {
+        const auto file = File::getSpecialLocation (File::userDocumentsDirectory)
+                              .getNonexistentChildFile ("Synth performance", ".json");
+
+        if (! file.replaceWithText (monitor.createReport()))
+            AlertWindow::showMessageBoxAsync (MessageBoxIconType::WarningIcon, "Performance report",
+                                              "Couldn't write " + file.getFullPathName());
+    }
+
+private:
+    void timerCallback() override
+    {
+        const auto& summary = monitor.update (deviceManager.getXRunCount());
+
+        String newText;
+        newText << "CPU " << roundToInt (summary.load * 100.0) << "% (peak " << roundToInt (summary.peakLoad * 100.0) << "%)"
+                << "   worst " << String (summary.worstBlockTime / 1000.0, 2) << " of " << String (summary.blockBudget / 1000.0, 2) << " ms"
+                << "   overruns " << summary.numOverruns
+                << ", xruns " << (summary.deviceXRuns >= 0 ? String (summary.deviceXRuns) : String ("n/a"))
+                << "   voices " << summary.numActiveVoices << "  |";
+
+        for (auto stage = 0; stage < PerformanceMonitor::numStages; ++stage)
+            newText << "  " << PerformanceMonitor::getStageName (stage) << " " << roundToInt (summary.meanStageTime[(size_t) stage]);
+
+        newText << " us";
+
+        const auto newColour = summary.peakLoad > 0.8
+                                || summary.numOverruns > lastNumOverruns
+                                || summary.deviceXRuns > lastDeviceXRuns ? Colours::orange : Colours::lightgrey;
+        lastNumOverruns = summary.numOverruns;
+        lastDeviceXRuns = summary.deviceXRuns;
+
+        if (newText != text || newColour != textColour)
+        {
+            text = newText;
+            textColour = newColour;
+            repaint();
+        }
+    }
+
+    PerformanceMonitor& monitor;
+    AudioDeviceManager& deviceManager;
+    String text;
+    Colour textColour { Colours::lightgrey };
+    int lastNumOverruns = 0, lastDeviceXRuns = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerformanceOverlay)
+};
@@ -0,0 +1,654 @@
+/*
+  ==============================================================================
+
+    This file contains the Synthesiser subclass the demo uses to manage its voices.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "VoiceRenderPool.h"
+#include "MidiEventScheduler.h"
+#include "VoiceModulation.h"
+
+//==============================================================================
+/**
+    A voice that can report how loud it currently is, so that when the synth runs
+    out of voices it can steal the one that will be missed least, and that can read
+    the controllers on its note's channel.
+*/
+class PolySynthesiserVoice : public SynthesiserVoice
+{
+public:
+    /** Returns the voice's current output level, where 1.0 is a full-scale note. This is
+        only called from the audio thread, between calls to renderNextBlock().
+    */
+    virtual float getCurrentLevel() const noexcept = 0;
+
+    /** Returns the pitch wheel and controllers of the channel the current note is
+        playing on. PolySynthesiser sets this before it calls startNote(), and keeps it
+        up to date, so it can be read at any time while rendering.
+    */
+    const MidiChannelState& getChannelState() const noexcept    { return *channelState; }
+
+private:
+    friend class PolySynthesiser;
+
+    static inline const MidiChannelState defaultChannelState;
+    const MidiChannelState* channelState = &defaultChannelState;
+};
+
+//==============================================================================
+/**
+    Keeps track of which voices are free, held or releasing.
+
+    Each voice is a node in exactly one intrusive, index-linked list, so finding a free
+    voice, or moving a voice from one list to another, doesn't depend on how many
+    voices there are. Voices are grouped by their class, on the assumption that all
+    the voices of one class can play the same sounds, and each group has its own lists.
+*/
+class VoiceAllocator
+{
+public:
+    enum class State { free, held, releasing, numStates };
+
+    VoiceAllocator() = default;
+
+    /** Rebuilds the lists for a new set of voices. This allocates, so don't call it
+        from the audio thread.
+    */
+    void reset (const OwnedArray<SynthesiserVoice>& voicesToUse)
+    {
+        slots.clear();
+        groups.clear();
+        slots.resize ((size_t) voicesToUse.size());
+
+        for (auto i = 0; i < voicesToUse.size(); ++i)
+        {
+            auto* voice = voicesToUse.getUnchecked (i);
+            auto& slot = slots[(size_t) i];
+
+            slot.voice = voice;
+            slot.polyVoice = dynamic_cast<PolySynthesiserVoice*> (voice);
+
+            auto group = std::find_if (groups.begin(), groups.end(), [voice] (const Group& g)
+            {
+                return typeid (*g.representative) == typeid (*voice);
+            });
+
+            if (group == groups.end())
+            {
+                groups.push_back ({});
+                groups.back().representative = voice;
+                group = std::prev (groups.end());
+            }
+
+            slot.group = (int) std::distance (groups.begin(), group);
+            append (i, State::free);
+            update (i);
+        }
+    }
+
+    int getNumVoices() const noexcept       { return (int) slots.size(); }
+    int getNumGroups() const noexcept       { return (int) groups.size(); }
+
+    SynthesiserVoice* getVoice (int index) const noexcept   { return slots[(size_t) index].voice; }
+    State getState (int index) const noexcept               { return slots[(size_t) index].state; }
+
+    /** Returns the voice as a PolySynthesiserVoice, or nullptr if it isn't one. */
+    PolySynthesiserVoice* getPolyVoice (int index) const noexcept   { return slots[(size_t) index].polyVoice; }
+
+    /** Returns the group whose voices can play this sound, or -1 if there isn't one. */
+    int findGroupFor (SynthesiserSound* sound) const
+    {
+        for (size_t i = 0; i < groups.size(); ++i)
+            if (groups[i].representative->canPlaySound (sound))
+                return (int) i;
+
+        return -1;
+    }
+
+    /** Returns the index of a free voice in a group, or -1 if they're all busy. */
+    int findFreeVoice (int group) const noexcept
+    {
+        return groups[(size_t) group].lists[(size_t) State::free].first;
+    }
+
+    /** Returns the index of the voice in a group that is quietest, preferring voices
+        that have been released over ones that are still held, or -1 if there are none.
+    */
+    int findVoiceToSteal (int group) const noexcept
+    {
+        for (auto state : { State::releasing, State::held })
+        {
+            auto quietest = -1;
+            auto quietestLevel = std::numeric_limits<float>::max();
+
+            for (auto i = getFirst (group, state); i >= 0; i = getNext (i))
+            {
+                const auto level = getLevel (i);
+
+                if (level < quietestLevel)
+                {
+                    quietest = i;
+                    quietestLevel = level;
+                }
+            }
+
+            if (quietest >= 0)
+                return quietest;
+        }
+
+        return -1;
+    }
+
+    /** Returns true if a voice can report its level, and it's below the given gain. */
+    bool isQuieterThan (int index, float threshold) const noexcept
+    {
+        const auto* polyVoice = slots[(size_t) index].polyVoice;
+        return polyVoice != nullptr && polyVoice->getCurrentLevel() < threshold;
+    }
+
+    /** Moves a voice to the list that matches what it's currently doing. */
+    void update (int index) noexcept
+    {
+        const auto* voice = slots[(size_t) index].voice;
+        const auto newState = ! voice->isVoiceActive()        ? State::free
+                            : voice->isPlayingButReleased()   ? State::releasing
+                                                              : State::held;
+
+        if (newState != slots[(size_t) index].state)
+        {
+            unlink (index);
+            append (index, newState);
+        }
+    }
+
+    /** Brings every sounding voice's state up to date, e.g. after rendering, when some
+        may have finished, or after an event that could have changed many at once.
+    */
+    void updateSoundingVoices() noexcept
+    {
+        for (auto group = 0; group < getNumGroups(); ++group)
+        {
+            for (auto state : { State::held, State::releasing })
+            {
+                for (auto i = getFirst (group, state); i >= 0;)
+                {
+                    const auto next = getNext (i);  // update() may move this one to another list
+                    update (i);
+                    i = next;
+                }
+            }
+        }
+    }
+
+    /** Iterating a list: returns the first voice in it, or -1. */
+    int getFirst (int group, State state) const noexcept    { return groups[(size_t) group].lists[(size_t) state].first; }
+
+    /** Iterating a list: returns the voice after this one in its list, or -1. */
+    int getNext (int index) const noexcept                  { return slots[(size_t) index].next; }
+
+private:
+    struct Slot
+    {
+        SynthesiserVoice* voice = nullptr;
+        PolySynthesiserVoice* polyVoice = nullptr;
+        int group = 0;
+        State state = State::free;
+        int previous = -1, next = -1;
+    };
+
+    struct List
+    {
+        int first = -1, last = -1;
+    };
+
+    struct Group
+    {
+        SynthesiserVoice* representative = nullptr;
+        std::array<List, (size_t) State::numStates> lists;
+    };
+
+    float getLevel (int index) const noexcept
+    {
+        const auto& slot = slots[(size_t) index];
+
+        if (slot.polyVoice != nullptr)
+            return slot.polyVoice->getCurrentLevel();
+
+        // a voice that can't say how loud it is is assumed to be fading once it's released
+        return slot.state == State::releasing ? 0.5f : 1.0f;
+    }
+
+    void unlink (int index) noexcept
+    {
+        auto& slot = slots[(size_t) index];
+        auto& list = groups[(size_t) slot.group].lists[(size_t) slot.state];
+
+        if (slot.previous >= 0)  slots[(size_t) slot.previous].next = slot.next;
+        else                     list.first = slot.next;
+
+        if (slot.next >= 0)      slots[(size_t) slot.next].previous = slot.previous;
+        else                     list.last = slot.previous;
+
+        slot.previous = slot.next = -1;
+    }
+
+    void append (int index, State newState) noexcept
+    {
+        auto& slot = slots[(size_t) index];
+        auto& list = groups[(size_t) slot.group].lists[(size_t) newState];
+
+        slot.state = newState;
+        slot.previous = list.last;
+        slot.next = -1;
+
+        if (list.last >= 0)  slots[(size_t) list.last].next = index;
+        else                 list.first = index;
+
+        list.last = index;
+    }
+
+    std::vector<Slot> slots;
+    std::vector<Group> groups;
+
+    JUCE_DECLARE_NON_COPYABLE (VoiceAllocator)
+};
+
+//==============================================================================
+/**
+    A Synthesiser that allocates its voices through a VoiceAllocator, and can hand
+    them to a VoiceRenderPool to be rendered.
+
+    Note-ons, note-offs and rendering only look at the voices that are sounding, a
+    free voice is found without a search, and when there isn't one, the quietest voice
+    is stolen rather than the oldest. Released voices that fade below -96 dB are
+    stopped rather than left to finish tails that can't be heard. Rendering is spread
+    across the pool's threads, if there is one, when there are enough sounding voices
+    to make that worthwhile.
+
+    MIDI events are handled at their exact sample positions without splitting the
+    block for every voice. Before an event changes a voice, that voice alone renders
+    up to the event; at the end of the block every sounding voice renders the rest in
+    one go. So a burst of events only costs the voices it touches a few short renders,
+    and the redundant controller changes are dropped by a MidiEventScheduler first.
+*/
+class PolySynthesiser : public Synthesiser
+{
+public:
+    PolySynthesiser() = default;
+
+    /** Fewer sounding voices than this are rendered on the audio thread alone, as
+        waking the workers would cost more than it saves.
+    */
+    static constexpr int minVoicesForParallelRendering = 8;
+
+    /** A released voice whose level drops below this is stopped straight away. */
+    static constexpr float silenceThreshold = 1.5849e-5f; // -96 dB
+
+    /** Sets the pool to render with, or nullptr to render everything on the audio
+        thread. The pool must already be prepared, and must outlive its use here.
+    */
+    void setVoiceRenderPool (VoiceRenderPool* newPool)
+    {
+        const ScopedLock sl (lock);
+        renderPool = newPool;
+    }
+
+    /** Call this with false if the voices send their output somewhere other than the
+        buffer they render into, e.g. a VoiceFilterBank, so the render pool doesn't
+        clear and add up sub-mixes that will only ever hold silence.
+    */
+    void setVoicesMixIntoOutput (bool shouldMixIntoOutput)
+    {
+        const ScopedLock sl (lock);
+        voicesMixIntoOutput = shouldMixIntoOutput;
+    }
+
+    /** Restricts note-ons to one of the synth's sounds, or lets any sound play if it's
+        nullptr. This doesn't lock, so switching sounds never holds up the audio thread,
+        but it must only be called from the audio thread, or before playback starts.
+    */
+    void setActiveSound (SynthesiserSound* newActiveSound) noexcept
+    {
+        activeSound = newActiveSound;
+    }
+
+    /** Rebuilds the voice lists. Call this after adding or removing voices, and before
+        the audio thread starts using the synth.
+    */
+    void prepareVoiceList()
+    {
+        const ScopedLock sl (lock);
+        allocator.reset (voices);
+        voicesToRender.ensureStorageAllocated (voices.size());
+        voiceStartSamples.ensureStorageAllocated (voices.size());
+        renderedUntil.assign ((size_t) voices.size(), 0);
+    }
+
+    /** Allocates the list each block's MIDI events are sorted in. Call this before the
+        audio thread starts using the synth.
+    */
+    void prepareEventScheduler (int maxEventsPerBlock)
+    {
+        const ScopedLock sl (lock);
+        scheduler.prepare (maxEventsPerBlock);
+    }
+
+    /** Renders a block, handling its MIDI events at their own sample positions. This
+        hides Synthesiser::renderNextBlock(), which splits the block at every event.
+    */
+    void renderNextBlock (AudioBuffer<float>& outputAudio, const MidiBuffer& inputMidi, int startSample, int numSamples)
+    {
+        const ScopedLock sl (lock);
+        jassert (renderedUntil.size() == (size_t) voices.size()); // did you forget to call prepareVoiceList()?
+
+        if (numSamples <= 0)
+            return;
+
+        scheduler.clear();
+        scheduler.addEvents (inputMidi, startSample, numSamples);
+        scheduler.sortAndCoalesce();
+
+        currentOutput = &outputAudio;
+        eventPosition = startSample;
+        forEachSoundingVoice ([this, startSample] (int index, SynthesiserVoice&) { renderedUntil[(size_t) index] = startSample; });
+
+        for (const auto& event : scheduler)
+        {
+            eventPosition = event.samplePosition;
+            handleMidiEvent (event.toMessage());
+        }
+
+        renderSoundingVoices (outputAudio, startSample, numSamples);
+        currentOutput = nullptr;
+    }
+
+    /** Returns how many controller changes have been dropped as redundant. */
+    int64 getNumCoalescedEvents() const noexcept    { return scheduler.getNumCoalesced(); }
+
+    /** Returns the controller values last received on a channel, from 1 to 16. Call
+        this from the audio thread only.
+    */
+    const MidiChannelState& getChannelState (int midiChannel) const noexcept
+    {
+        return channelStates[(size_t) jlimit (1, 16, midiChannel) - 1];
+    }
+
+    //==============================================================================
+    void noteOn (int midiChannel, int midiNoteNumber, float velocity) override
+    {
+        const ScopedLock sl (lock);
+        jassert (allocator.getNumVoices() == voices.size()); // did you forget to call prepareVoiceList()?
+
+        for (auto* sound : sounds)
+        {
+            if (activeSound != nullptr && sound != activeSound)
+                continue;
+
+            if (! (sound->appliesToNote (midiNoteNumber) && sound->appliesToChannel (midiChannel)))
+                continue;
+
+            const auto group = allocator.findGroupFor (sound);
+
+            if (group < 0)
+                continue;
+
+            // if this note is still ringing, because of the sustain or sostenuto pedal, stop it first
+            forEachVoiceIn (group, VoiceAllocator::State::held, [&] (int index, SynthesiserVoice& voice)
+            {
+                if (voice.getCurrentlyPlayingNote() == midiNoteNumber && voice.isPlayingChannel (midiChannel))
+                {
+                    catchUp (index);
+                    stopVoice (&voice, 1.0f, true);
+                    allocator.update (index);
+                }
+            });
+
+            auto index = allocator.findFreeVoice (group);
+
+            if (index < 0 && isNoteStealingEnabled())
+                index = allocator.findVoiceToSteal (group);
+
+            if (index >= 0)
+            {
+                catchUp (index);    // in case it's being stolen
+
+                if (auto* polyVoice = allocator.getPolyVoice (index))
+                    polyVoice->channelState = &getEditableChannelState (midiChannel);
+
+                startVoice (allocator.getVoice (index), sound, midiChannel, midiNoteNumber, velocity);
+                allocator.update (index);
+            }
+        }
+    }
+
+    void noteOff (int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) override
+    {
+        const ScopedLock sl (lock);
+
+        for (auto group = 0; group < allocator.getNumGroups(); ++group)
+        {
+            forEachVoiceIn (group, VoiceAllocator::State::held, [&] (int index, SynthesiserVoice& voice)
+            {
+                if (voice.getCurrentlyPlayingNote() != midiNoteNumber || ! voice.isPlayingChannel (midiChannel))
+                    return;
+
+                if (auto sound = voice.getCurrentlyPlayingSound())
+                {
+                    if (sound->appliesToNote (midiNoteNumber) && sound->appliesToChannel (midiChannel))
+                    {
+                        catchUp (index);
+                        voice.setKeyDown (false);
+
+                        if (! (voice.isSustainPedalDown() || voice.isSostenutoPedalDown()))
+                            stopVoice (&voice, velocity, allowTailOff);
+
+                        allocator.update (index);
+                    }
+                }
+            });
+        }
+    }
+
+    // these are rare, and can change any number of voices, so they just resync the lists afterwards
+    void allNotesOff (int midiChannel, bool allowTailOff) override
+    {
+        const ScopedLock sl (lock);
+        catchUpChannel (midiChannel);
+        Synthesiser::allNotesOff (midiChannel, allowTailOff);
+        allocator.updateSoundingVoices();
+    }
+
+    void handleSustainPedal (int midiChannel, bool isDown) override
+    {
+        const ScopedLock sl (lock);
+        catchUpChannel (midiChannel);
+        Synthesiser::handleSustainPedal (midiChannel, isDown);
+        allocator.updateSoundingVoices();
+    }
+
+    void handleSostenutoPedal (int midiChannel, bool isDown) override
+    {
+        const ScopedLock sl (lock);
+        catchUpChannel (midiChannel);
+        Synthesiser::handleSostenutoPedal (midiChannel, isDown);
+        allocator.updateSoundingVoices();
+    }
+
+    // the rest only change the voices on their channel, so only those are caught up
+    void handlePitchWheel (int midiChannel, int wheelValue) override
+    {
+        const ScopedLock sl (lock);
+        catchUpChannel (midiChannel);
+        getEditableChannelState (midiChannel).pitchWheel = wheelValue;
+        Synthesiser::handlePitchWheel (midiChannel, wheelValue);
+    }
+
+    void handleController (int midiChannel, int controllerNumber, int controllerValue) override
+    {
+        const ScopedLock sl (lock);
+        catchUpChannel (midiChannel);
+
+        auto& state = getEditableChannelState (midiChannel);
+
+        if (controllerNumber == MidiChannelState::resetAllControllers)
+            state.reset();
+        else if (isPositiveAndBelow (controllerNumber, 128))
+            state.controllers[(size_t) controllerNumber] = (uint8) jlimit (0, 127, controllerValue);
+
+        Synthesiser::handleController (midiChannel, controllerNumber, controllerValue);
+    }
+
+    void handleAftertouch (int midiChannel, int midiNoteNumber, int aftertouchValue) override
+    {
+        const ScopedLock sl (lock);
+        catchUpChannel (midiChannel);
+        Synthesiser::handleAftertouch (midiChannel, midiNoteNumber, aftertouchValue);
+    }
+
+    void handleChannelPressure (int midiChannel, int channelPressureValue) override
+    {
+        const ScopedLock sl (lock);
+        catchUpChannel (midiChannel);
+        Synthesiser::handleChannelPressure (midiChannel, channelPressureValue);
+    }
+
+protected:
+    // only used if the synth is driven through Synthesiser::renderNextBlock()
+    void renderVoices (AudioBuffer<float>& outputAudio, int startSample, int numSamples) override
+    {
+        forEachSoundingVoice ([this, startSample] (int index, SynthesiserVoice&) { renderedUntil[(size_t) index] = startSample; });
+        renderSoundingVoices (outputAudio, startSample, numSamples);
+    }
+
+    using Synthesiser::renderVoices;
+
+private:
+    /** Renders every sounding voice from wherever it has got to up to the end of the
+        region, then retires the ones that have finished.
+    */
+    void renderSoundingVoices (AudioBuffer<float>& outputAudio, int startSample, int numSamples)
+    {
+        // only the voices that are sounding get visited; idle ones cost nothing. These
+        // were sized up front, so they never allocate
+        voicesToRender.clearQuick();
+        voiceStartSamples.clearQuick();
+
+        forEachSoundingVoice ([this] (int index, SynthesiserVoice& voice)
+        {
+            voicesToRender.add (&voice);
+            voiceStartSamples.add (renderedUntil[(size_t) index]);
+        });
+
+        if (voicesToRender.isEmpty())
+            return;
+
+        if (renderPool != nullptr
+             && voicesToRender.size() >= minVoicesForParallelRendering
+             && renderPool->canRender (outputAudio, startSample, numSamples))
+        {
+            renderPool->render (voicesToRender.data(), voiceStartSamples.data(), voicesToRender.size(),
+                                outputAudio, startSample, numSamples, voicesMixIntoOutput);
+        }
+        else
+        {
+            const auto endSample = startSample + numSamples;
+
+            for (auto i = 0; i < voicesToRender.size(); ++i)
+                if (const auto start = voiceStartSamples.getUnchecked (i); start < endSample)
+                    voicesToRender.getUnchecked (i)->renderNextBlock (outputAudio, start, endSample - start);
+        }
+
+        stopSilentVoices();
+
+        // voices that have finished their tails go back on the free list
+        allocator.updateSoundingVoices();
+    }
+
+    /** Renders one voice up to the position of the event being handled, so that the
+        event takes effect at exactly that sample.
+    */
+    void catchUp (int index)
+    {
+        if (currentOutput == nullptr)
+            return;
+
+        auto& position = renderedUntil[(size_t) index];
+        auto* voice = allocator.getVoice (index);
+
+        if (position < eventPosition && voice->isVoiceActive())
+            voice->renderNextBlock (*currentOutput, position, eventPosition - position);
+
+        position = eventPosition;
+    }
+
+    void catchUpChannel (int midiChannel)
+    {
+        if (currentOutput == nullptr)
+            return;
+
+        forEachSoundingVoice ([this, midiChannel] (int index, SynthesiserVoice& voice)
+        {
+            if (midiChannel <= 0 || voice.isPlayingChannel (midiChannel))
+                catchUp (index);
+        });
+    }
+
+    /** Cuts off released voices that have faded below silenceThreshold, rather than
+        rendering the rest of a tail nobody can hear.
+    */
+    void stopSilentVoices()
+    {
+        for (auto group = 0; group < allocator.getNumGroups(); ++group)
+        {
+            forEachVoiceIn (group, VoiceAllocator::State::releasing, [this] (int index, SynthesiserVoice& voice)
+            {
+                if (allocator.isQuieterThan (index, silenceThreshold))
+                    stopVoice (&voice, 0.0f, false);
+            });
+        }
+    }
+
+    MidiChannelState& getEditableChannelState (int midiChannel) noexcept
+    {
+        return channelStates[(size_t) jlimit (1, 16, midiChannel) - 1];
+    }
+
+    template <typename Function>
+    void forEachSoundingVoice (Function&& function)
+    {
+        for (auto group = 0; group < allocator.getNumGroups(); ++group)
+            for (auto state : { VoiceAllocator::State::held, VoiceAllocator::State::releasing })
+                forEachVoiceIn (group, state, function);
+    }
+
+    template <typename Function>
+    void forEachVoiceIn (int group, VoiceAllocator::State state, Function&& function)
+    {
+        for (auto i = allocator.getFirst (group, state); i >= 0;)
+        {
+            const auto next = allocator.getNext (i);  // the function may move this voice to another list
+            function (i, *allocator.getVoice (i));
+            i = next;
+        }
+    }
+
+    VoiceAllocator allocator;
+    VoiceRenderPool* renderPool = nullptr;
+    bool voicesMixIntoOutput = true;
+    SynthesiserSound* activeSound = nullptr;
+    Array<SynthesiserVoice*> voicesToRender;
+    Array<int> voiceStartSamples;
+
+    // how far through the current block each voice has rendered, by allocator index
+    std::vector<int> renderedUntil;
+    MidiEventScheduler scheduler;
+    std::array<MidiChannelState, 16> channelStates;
+    AudioBuffer<float>* currentOutput = nullptr;    // only set while renderNextBlock() is running
+    int eventPosition = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PolySynthesiser)
+};
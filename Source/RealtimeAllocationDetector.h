@@ -0,0 +1,109 @@
+/*
+  ==============================================================================
+
+    This file contains a debug-build check that nothing allocates memory while
+    the audio callback is running.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#ifndef SYNTH_DETECT_REALTIME_ALLOCATIONS
+ #define SYNTH_DETECT_REALTIME_ALLOCATIONS JUCE_DEBUG
+#endif
+
+//==============================================================================
+/**
+    Catches heap allocations made on the audio thread.
+
+    Put a ScopedRealtimeSection at the top of any function that has to be
+    realtime-safe. While one is alive on a thread, any call to operator new on that
+    thread (and, on Linux, malloc, calloc and realloc too) hits an assertion, so a
+    debugger stops at the allocation itself rather than at the xrun it causes later.
+
+    The allocation functions are only replaced in builds that expand
+    SYNTH_DEFINE_REALTIME_ALLOCATION_HOOKS() once, at file scope, in one of their
+    .cpp files. In release builds all of this compiles away to nothing.
+*/
+namespace RealtimeAllocationDetector
+{
+    /** How many ScopedRealtimeSections are currently alive on the calling thread. */
+    inline int& getRealtimeDepth() noexcept
+    {
+        // constant-initialised and trivially destructible, so reading it can't allocate
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    /** Called by the replacement allocation functions before every allocation. */
+    inline void allocationHappened() noexcept
+    {
+        auto& depth = getRealtimeDepth();
+
+        if (depth > 0)
+        {
+            // reporting the assertion may allocate, so step out of the section while it does
+            const auto savedDepth = std::exchange (depth, 0);
+            jassertfalse; // something allocated memory on the audio thread!
+            depth = savedDepth;
+        }
+    }
+
+    /** Marks the calling thread as realtime for as long as this object exists. */
+    struct ScopedRealtimeSection
+    {
+       #if SYNTH_DETECT_REALTIME_ALLOCATIONS
+        ScopedRealtimeSection() noexcept    { ++getRealtimeDepth(); }
+        ~ScopedRealtimeSection() noexcept   { --getRealtimeDepth(); }
+       #else
+        ScopedRealtimeSection() noexcept    {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedRealtimeSection)
+    };
+}
+
+//==============================================================================
+#if SYNTH_DETECT_REALTIME_ALLOCATIONS
+
+ #if JUCE_LINUX && defined (__GLIBC__)
+  extern "C" void* __libc_malloc (size_t);
+  extern "C" void* __libc_calloc (size_t, size_t);
+  extern "C" void* __libc_realloc (void*, size_t);
+
+  #define SYNTH_UNCHECKED_MALLOC __libc_malloc
+
+  // JUCE's own containers (HeapBlock, and so Array and MidiBuffer) use malloc
+  // directly, so on glibc those are caught as well as operator new
+  #define SYNTH_DEFINE_REALTIME_MALLOC_HOOKS() \
+     extern "C" void* malloc (size_t size)                 { RealtimeAllocationDetector::allocationHappened(); return __libc_malloc (size); } \
+     extern "C" void* calloc (size_t num, size_t size)     { RealtimeAllocationDetector::allocationHappened(); return __libc_calloc (num, size); } \
+     extern "C" void* realloc (void* ptr, size_t size)     { RealtimeAllocationDetector::allocationHappened(); return __libc_realloc (ptr, size); }
+ #else
+  #define SYNTH_UNCHECKED_MALLOC std::malloc
+  #define SYNTH_DEFINE_REALTIME_MALLOC_HOOKS()
+ #endif
+
+ #define SYNTH_DEFINE_REALTIME_ALLOCATION_HOOKS() \
+    void* operator new (size_t size, const std::nothrow_t&) noexcept \
+    { \
+        RealtimeAllocationDetector::allocationHappened(); \
+        return SYNTH_UNCHECKED_MALLOC (size > 0 ? size : 1); \
+    } \
+    void* operator new (size_t size) \
+    { \
+        if (auto* p = operator new (size, std::nothrow)) return p; \
+        throw std::bad_alloc(); \
+    } \
+    void* operator new[] (size_t size)                                  { return operator new (size); } \
+    void* operator new[] (size_t size, const std::nothrow_t&) noexcept  { return operator new (size, std::nothrow); } \
+    void operator delete (void* p) noexcept                             { std::free (p); } \
+    void operator delete[] (void* p) noexcept                           { std::free (p); } \
+    void operator delete (void* p, size_t) noexcept                     { std::free (p); } \
+    void operator delete[] (void* p, size_t) noexcept                   { std::free (p); } \
+    SYNTH_DEFINE_REALTIME_MALLOC_HOOKS()
+
+#else
+ #define SYNTH_DEFINE_REALTIME_ALLOCATION_HOOKS()
+#endif
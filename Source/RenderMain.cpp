@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+    This file contains the startup code for the headless offline renderer.
+
+    It renders a MIDI file through the demo synth faster than realtime, without
+    opening an audio device, and prints how long it took.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "OfflineRenderer.h"
+
+// in debug builds, this makes any allocation on the audio thread hit an assertion
+SYNTH_DEFINE_REALTIME_ALLOCATION_HOOKS()
+
+//==============================================================================
+static SineWaveVoice::WaveType parseWaveType (const String& name)
+{
+    if (name.isEmpty() || name.equalsIgnoreCase ("sine"))   return SineWaveVoice::Sine;
+    if (name.equalsIgnoreCase ("square"))                   return SineWaveVoice::Square;
+    if (name.equalsIgnoreCase ("saw"))                      return SineWaveVoice::Sawtooth;
+    if (name.equalsIgnoreCase ("triangle"))                 return SineWaveVoice::Triangle;
+
+    ConsoleApplication::fail ("Unknown waveform: " + name);
+    return SineWaveVoice::Sine;
+}
+
+static ResamplingQuality parseResamplingQuality (const String& name)
+{
+    if (name.isEmpty() || name.equalsIgnoreCase ("high"))   return ResamplingQuality::high;
+    if (name.equalsIgnoreCase ("standard"))                 return ResamplingQuality::standard;
+    if (name.equalsIgnoreCase ("fast"))                     return ResamplingQuality::fast;
+
+    ConsoleApplication::fail ("Unknown resampling quality: " + name);
+    return ResamplingQuality::high;
+}
+
+static FilterType parseFilterType (const String& name)
+{
+    if (name.isEmpty() || name.equalsIgnoreCase ("lowpass"))    return FilterType::lowPass;
+    if (name.equalsIgnoreCase ("highpass"))                     return FilterType::highPass;
+    if (name.equalsIgnoreCase ("bandpass"))                     return FilterType::bandPass;
+    if (name.equalsIgnoreCase ("notch"))                        return FilterType::notch;
+
+    ConsoleApplication::fail ("Unknown filter type: " + name);
+    return FilterType::lowPass;
+}
+
+static double getDoubleOption (const ArgumentList& args, StringRef option, double defaultValue)
+{
+    auto value = args.getValueForOption (option);
+    return value.isNotEmpty() ? value.getDoubleValue() : defaultValue;
+}
+
+static void runRender (const ArgumentList& args)
+{
+    OfflineRenderSettings settings;
+
+    if (args.containsOption ("--trace"))
+        settings.midiTrace = args.getExistingFileForOption ("--trace");
+    else
+        settings.midiFile = args.getExistingFileForOption ("--midi");
+
+    settings.sampleRate        = getDoubleOption (args, "--rate", settings.sampleRate);
+    settings.blockSize         = jmax (1, (int) getDoubleOption (args, "--block", settings.blockSize));
+    settings.numVoicesPerSound = jmax (1, (int) getDoubleOption (args, "--voices", settings.numVoicesPerSound));
+    settings.numRenderThreads  = jmax (0, (int) getDoubleOption (args, "--threads", settings.numRenderThreads));
+    settings.tailSeconds       = getDoubleOption (args, "--tail", settings.tailSeconds);
+    settings.useSampledSound   = args.containsOption ("--sampled");
+    settings.waveType          = parseWaveType (args.getValueForOption ("--wave"));
+    settings.resamplingQuality = parseResamplingQuality (args.getValueForOption ("--quality"));
+    settings.filterType        = parseFilterType (args.getValueForOption ("--filter"));
+    settings.cutoff            = getDoubleOption (args, "--cutoff", settings.cutoff);
+    settings.resonance         = getDoubleOption (args, "--resonance", settings.resonance);
+    settings.filterDrive       = (float) getDoubleOption (args, "--drive", settings.filterDrive);
+
+    if (args.containsOption ("--oversample"))
+    {
+        settings.oversamplingFactor = (int) getDoubleOption (args, "--oversample", 1.0);
+
+        if (settings.oversamplingFactor != 1 && settings.oversamplingFactor != 2
+             && settings.oversamplingFactor != 4 && settings.oversamplingFactor != 8)
+            ConsoleApplication::fail ("The oversampling factor must be 1, 2, 4 or 8");
+    }
+
+    settings.envelope.attack  = (float) getDoubleOption (args, "--attack",  settings.envelope.attack);
+    settings.envelope.decay   = (float) getDoubleOption (args, "--decay",   settings.envelope.decay);
+    settings.envelope.sustain = (float) getDoubleOption (args, "--sustain", settings.envelope.sustain);
+    settings.envelope.release = (float) getDoubleOption (args, "--release", settings.envelope.release);
+
+    auto& modulation = settings.modulation;
+    modulation.pitchBendRange = (float) getDoubleOption (args, "--bend-range", modulation.pitchBendRange);
+    modulation.lfoRate        = (float) getDoubleOption (args, "--lfo-rate",   modulation.lfoRate);
+    modulation.vibratoDepth   = (float) getDoubleOption (args, "--vibrato",    modulation.vibratoDepth);
+    modulation.tremoloDepth   = (float) getDoubleOption (args, "--tremolo",    modulation.tremoloDepth);
+    modulation.filterEnvelopeAmount = (float) getDoubleOption (args, "--filter-env", modulation.filterEnvelopeAmount);
+
+    if (args.containsOption ("--exponential"))
+        settings.envelopeCurve = BlockEnvelope::Curve::exponential;
+
+    if (args.containsOption ("--instrument"))
+        settings.instrumentManifest = args.getExistingFileForOption ("--instrument");
+
+    if (args.containsOption ("--stream"))
+    {
+        settings.streamedSample = args.getExistingFileForOption ("--stream");
+        settings.streamedSampleRootNote = (int) getDoubleOption (args, "--root", settings.streamedSampleRootNote);
+    }
+
+    if (args.containsOption ("--out"))
+        settings.outputFile = args.getFileForOption ("--out");
+
+    OfflineRenderStats stats;
+    auto result = OfflineRenderer (settings).render (stats);
+
+    if (result.failed())
+        ConsoleApplication::fail (result.getErrorMessage());
+
+    std::cout << "rendered:        " << stats.audioSeconds << " s (" << stats.numBlocks << " blocks of "
+                                     << settings.blockSize << " @ " << settings.sampleRate << " Hz)" << std::endl
+              << "render time:     " << stats.renderSeconds << " s" << std::endl
+              << "realtime factor: " << stats.realtimeFactor << "x" << std::endl
+              << "block time (us): p50 " << stats.blockTimeP50
+                                         << "  p90 " << stats.blockTimeP90
+                                         << "  p99 " << stats.blockTimeP99
+                                         << "  max " << stats.blockTimeMax << std::endl
+              << "peak voices:     " << stats.peakVoices << std::endl;
+
+    if (settings.oversamplingFactor > 1)
+        std::cout << "latency:         " << stats.latencySamples << " samples, trimmed from the output" << std::endl;
+
+    if (settings.streamedSample != File() || settings.instrumentManifest != File())
+        std::cout << "stream underruns: " << stats.streamUnderruns << std::endl;
+}
+
+static void dumpTrace (const ArgumentList& args)
+{
+    MidiMessageSequence sequence;
+
+    if (auto result = MidiTraceRecorder::loadTrace (args.getExistingFileForOption ("--dump-trace"), sequence); result.failed())
+        ConsoleApplication::fail (result.getErrorMessage());
+
+    for (const auto* event : sequence)
+        std::cout << String (event->message.getTimeStamp() * 1000.0, 3) << " ms: "
+                  << event->message.getDescription() << std::endl;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ConsoleApplication app;
+
+    app.addHelpCommand ("--help|-h", "Usage:", false);
+
+    app.addCommand ({ "--dump-trace",
+                      "--dump-trace=file.miditrace",
+                      "Prints the messages in a recorded MIDI trace.",
+                      {},
+                      dumpTrace });
+
+    app.addDefaultCommand ({ "--midi",
+                             "--midi=file.mid [--out=file.wav] [options]",
+                             "Renders a MIDI file through the synth and reports the render cost.",
+                             "Options:\n"
+                             "  --trace=x.miditrace  replay a trace recorded by the demo instead of a MIDI file\n"
+                             "  --out=file.wav       write the rendered audio to a 24-bit WAV file\n"
+                             "  --rate=44100         sample rate in Hz\n"
+                             "  --block=512          block size in samples\n"
+                             "  --voices=16          number of voices per sound, from 8 to 512\n"
+                             "  --threads=0          extra threads to render the voices on\n"
+                             "  --wave=sine          sine, square, saw or triangle\n"
+                             "  --sampled            use the sampled cello sound instead of the oscillator\n"
+                             "  --stream=file.wav    stream a WAV or AIFF sample from disk instead\n"
+                             "  --root=60            the note at which the streamed sample plays at its own pitch\n"
+                             "  --instrument=x.json  play a multisampled instrument described by a manifest\n"
+                             "  --quality=high       how the samples are pitched: fast, standard or high\n"
+                             "  --attack, --decay, --sustain, --release   envelope settings\n"
+                             "  --exponential        use exponential decay and release segments\n"
+                             "  --filter=lowpass     lowpass, highpass, bandpass or notch\n"
+                             "  --cutoff=1000        filter cutoff in Hz\n"
+                             "  --resonance=0.7      filter Q\n"
+                             "  --drive=1            how hard the voices drive their filters; 1 is clean\n"
+                             "  --oversample=1       run the voices and filters at 2, 4 or 8 times the rate\n"
+                             "  --filter-env=0       octaves each voice's filter envelope opens its cutoff\n"
+                             "  --bend-range=2       pitch bend range in semitones\n"
+                             "  --lfo-rate=5         the voices' LFO rate in Hz\n"
+                             "  --vibrato=0.5        vibrato depth in semitones at full mod wheel\n"
+                             "  --tremolo=0          tremolo depth, from 0 to 1, at full mod wheel\n"
+                             "  --tail=2             seconds rendered after the last MIDI event",
+                             runRender });
+
+    return app.findAndRunCommand (argc, argv);
+}
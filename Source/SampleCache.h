@@ -0,0 +1,203 @@
+/*
+  ==============================================================================
+
+    This file contains the cache of decoded samples used by the sampler sounds.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "DemoUtilities.h"
+
+//==============================================================================
+/**
+    A decoded sample. Once it's in a SampleCache it never changes, so any number of
+    voices can read it at once.
+
+    A sample is either resident, in which case data holds all of it, converted to the
+    rate it will be played back at, or streamed, in which case data only holds its
+    first few seconds at the file's own rate, and the rest is read from a memory-mapped
+    file by a SampleStreamer while it plays.
+*/
+struct CachedSample
+{
+    // how many frames at the end of a streamed sample's head are repeated at the start
+    // of its stream, so that voices can interpolate across the join
+    static constexpr int streamOverlap = 64;
+
+    bool isStreamed() const noexcept            { return streamReader != nullptr; }
+    int64 getStreamStart() const noexcept       { return data.getNumSamples() - streamOverlap; }
+
+    AudioBuffer<float> data;
+    int64 lengthInSamples = 0;
+    double sampleRate = 0.0;
+    String name;
+
+    // only the SampleStreamer's thread reads through this
+    std::unique_ptr<MemoryMappedAudioFormatReader> streamReader;
+};
+
+//==============================================================================
+/**
+    Decodes each sample file once, and keeps the result for as long as the cache exists.
+
+    Samples are keyed by their path and by the sample rate they were prepared for, so
+    switching back to a sound, or back to a device rate, that has been used before
+    costs nothing. Paths can be absolute files, or the names of the demo's assets.
+
+    Loading happens on whatever thread calls getSample() or getStreamedSample(), and
+    may take a while, so keep it away from the audio thread. The samples themselves
+    are never freed until the cache is, so a voice can hold on to a CachedSample
+    pointer without any reference counting.
+*/
+class SampleCache
+{
+public:
+    SampleCache()
+    {
+        formatManager.registerBasicFormats();
+    }
+
+    /** Returns the sample at a path, prepared for a playback rate, decoding it if it
+        isn't already cached. Returns nullptr if the file can't be read.
+    */
+    const CachedSample* getSample (const String& path, double playbackSampleRate)
+    {
+        jassert (playbackSampleRate > 0.0);
+
+        const auto key = path + "@" + String (playbackSampleRate);
+        const ScopedLock sl (lock);
+
+        if (auto existing = samples.find (key); existing != samples.end())
+            return existing->second.get();
+
+        auto sample = loadSample (path, playbackSampleRate);
+        auto* result = sample.get();
+
+        if (result != nullptr)
+            samples.emplace (key, std::move (sample));
+
+        return result;
+    }
+
+    /** Returns a sample that will be streamed from disk, so that only its first
+        headLength frames take up memory, loading it if it isn't already cached. Only
+        formats that can be memory-mapped, i.e. WAV and AIFF, can be streamed; a file
+        shorter than its head is simply loaded whole. The same file streamed with two
+        head lengths is cached twice. Returns nullptr if the file can't be read.
+    */
+    const CachedSample* getStreamedSample (const File& file, int headLength = defaultHeadLength)
+    {
+        headLength = jmax (headLength, 4 * CachedSample::streamOverlap);
+
+        const auto key = file.getFullPathName() + "@stream" + String (headLength);
+        const ScopedLock sl (lock);
+
+        if (auto existing = samples.find (key); existing != samples.end())
+            return existing->second.get();
+
+        auto sample = loadStreamedSample (file, headLength);
+        auto* result = sample.get();
+
+        if (result != nullptr)
+            samples.emplace (key, std::move (sample));
+
+        return result;
+    }
+
+    static constexpr int defaultHeadLength = 16384;     // in frames
+
+    int getNumSamples() const
+    {
+        const ScopedLock sl (lock);
+        return (int) samples.size();
+    }
+
+private:
+    std::unique_ptr<AudioFormatReader> createReader (const String& path)
+    {
+        if (File::isAbsolutePath (path))
+            return std::unique_ptr<AudioFormatReader> (formatManager.createReaderFor (File (path)));
+
+        if (auto stream = createAssetInputStream (path.toRawUTF8(), AssertAssetExists::no))
+            return std::unique_ptr<AudioFormatReader> (formatManager.createReaderFor (std::move (stream)));
+
+        return {};
+    }
+
+    std::unique_ptr<CachedSample> loadSample (const String& path, double playbackSampleRate)
+    {
+        auto reader = createReader (path);
+
+        if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+            return {};
+
+        const auto numChannels = (int) jmin (2u, reader->numChannels);
+        const auto length = (int) reader->lengthInSamples;
+
+        AudioBuffer<float> decoded (numChannels, length);
+        reader->read (&decoded, 0, length, 0, true, numChannels > 1);
+
+        auto sample = std::make_unique<CachedSample>();
+        sample->name = path;
+        sample->sampleRate = playbackSampleRate;
+
+        const auto ratio = reader->sampleRate / playbackSampleRate;
+
+        if (approximatelyEqual (ratio, 1.0))
+        {
+            sample->data = std::move (decoded);
+            sample->lengthInSamples = length;
+            return sample;
+        }
+
+        // converting the rate once here means the voices only ever have to pitch the
+        // sample by the note's own ratio
+        const auto newLength = (int) std::ceil (length / ratio);
+        sample->data.setSize (numChannels, newLength);
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            LagrangeInterpolator interpolator;
+            interpolator.process (ratio, decoded.getReadPointer (channel), sample->data.getWritePointer (channel),
+                                  newLength, length, 0);
+        }
+
+        sample->lengthInSamples = newLength;
+        return sample;
+    }
+
+    std::unique_ptr<CachedSample> loadStreamedSample (const File& file, int headLength)
+    {
+        auto* format = formatManager.findFormatForFileExtension (file.getFileExtension());
+        std::unique_ptr<MemoryMappedAudioFormatReader> reader (format != nullptr ? format->createMemoryMappedReader (file) : nullptr);
+
+        // mapping the file only reserves address space; pages are read in as they're touched
+        if (reader == nullptr || ! reader->mapEntireFile() || reader->lengthInSamples <= 0)
+            return {};
+
+        const auto numChannels = (int) jmin (2u, reader->numChannels);
+        const auto length = reader->lengthInSamples;
+        const auto isStreamed = length > headLength;
+        const auto numResident = (int) (isStreamed ? headLength : length);
+
+        auto sample = std::make_unique<CachedSample>();
+        sample->name = file.getFullPathName();
+        sample->sampleRate = reader->sampleRate;
+        sample->lengthInSamples = length;
+        sample->data.setSize (numChannels, numResident);
+        reader->read (&sample->data, 0, numResident, 0, true, numChannels > 1);
+
+        if (isStreamed)
+            sample->streamReader = std::move (reader);
+
+        return sample;
+    }
+
+    AudioFormatManager formatManager;
+    std::map<String, std::unique_ptr<const CachedSample>> samples;
+    CriticalSection lock;
+
+    JUCE_DECLARE_NON_COPYABLE (SampleCache)
+};
@@ -0,0 +1,251 @@
+/*
+  ==============================================================================
+
+    This file contains the background reader that streams samples from disk.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SampleCache.h"
+
+//==============================================================================
+/**
+    A single-producer, single-consumer ring of sample frames that one voice plays a
+    streamed sample from.
+
+    The voice (on the audio thread) starts and stops the stream, and says how far it
+    has got; the SampleStreamer's thread reads the frames after the sample's head
+    into the ring ahead of it. Every start bumps a generation number, so the voice can
+    tell frames meant for its current note from ones left over from the last.
+
+    Frames are counted from the sample's stream start, and frame n lives at index
+    n & (ringSize - 1). The first guardSize frames of the ring are repeated after its
+    end, so that a voice can always read a short run of frames without wrapping.
+*/
+class SampleStream
+{
+public:
+    static constexpr int guardSize = 64;
+
+    SampleStream() = default;
+
+    /** Allocates the ring, which must be a power of two long. Don't call this while
+        the stream is being read or written.
+    */
+    void prepare (int newRingSize)
+    {
+        jassert (isPowerOfTwo (newRingSize) && newRingSize > guardSize);
+
+        ring.setSize (2, newRingSize + guardSize);
+        ring.clear();
+        ringSize = newRingSize;
+    }
+
+    int getRingSize() const noexcept    { return ringSize; }
+
+    //==============================================================================
+    /** Starts streaming a sample from its stream start, and returns the generation
+        the frames for it will be tagged with. Called by the voice.
+    */
+    uint32 start (const CachedSample* sampleToStream) noexcept
+    {
+        framesConsumed.store (0, std::memory_order_relaxed);
+        sample.store (sampleToStream, std::memory_order_relaxed);
+        return (requestedGeneration.fetch_add (1, std::memory_order_release) + 1) & generationMask;
+    }
+
+    /** Stops streaming, so the reader can forget about this stream. Called by the voice. */
+    void stop() noexcept
+    {
+        sample.store (nullptr, std::memory_order_relaxed);
+        requestedGeneration.fetch_add (1, std::memory_order_release);
+    }
+
+    /** Returns how many frames from the stream start have been read into the ring for
+        the given generation. Called by the voice.
+    */
+    int64 getNumFramesAvailable (uint32 generation) const noexcept
+    {
+        const auto progress = readProgress.load (std::memory_order_acquire);
+        return (uint32) (progress >> frameBits) == generation ? (int64) (progress & frameMask) : 0;
+    }
+
+    /** Tells the reader that the frames before this one can be overwritten. Called by
+        the voice.
+    */
+    void release (int64 frame) noexcept
+    {
+        framesConsumed.store (frame, std::memory_order_release);
+    }
+
+    const float* getReadPointer (int channel) const noexcept    { return ring.getReadPointer (channel); }
+
+    //==============================================================================
+    /** Reads as much of the sample into the ring as there's room for, up to one
+        bufferful at a time. Returns true if it read anything. Called by the
+        SampleStreamer's thread only.
+    */
+    bool fill (AudioBuffer<float>& readBuffer)
+    {
+        const auto generation = requestedGeneration.load (std::memory_order_acquire);
+
+        if (generation != servedGeneration)
+        {
+            servedGeneration = generation;
+            servedSample = sample.load (std::memory_order_relaxed);
+            framesWritten = 0;
+            publish();
+        }
+
+        if (servedSample == nullptr || ! servedSample->isStreamed())
+            return false;
+
+        const auto streamStart = servedSample->getStreamStart();
+        const auto space = ringSize - (framesWritten - framesConsumed.load (std::memory_order_acquire));
+        const auto remaining = servedSample->lengthInSamples - (streamStart + framesWritten);
+        const auto numToRead = (int) jmin (space, remaining, (int64) readBuffer.getNumSamples());
+
+        if (numToRead <= 0)
+            return false;
+
+        // this is where the memory-mapped file actually gets paged in
+        servedSample->streamReader->read (&readBuffer, 0, numToRead, streamStart + framesWritten, true, true);
+
+        const auto numSourceChannels = jmin (2, (int) servedSample->streamReader->numChannels);
+
+        for (auto channel = 0; channel < 2; ++channel)
+        {
+            const auto* source = readBuffer.getReadPointer (jmin (channel, numSourceChannels - 1));
+            auto* dest = ring.getWritePointer (channel);
+
+            for (auto done = 0; done < numToRead;)
+            {
+                const auto index = (int) ((framesWritten + done) & (ringSize - 1));
+                const auto numThisTime = jmin (numToRead - done, ringSize - index);
+
+                FloatVectorOperations::copy (dest + index, source + done, numThisTime);
+
+                if (index < guardSize)
+                    FloatVectorOperations::copy (dest + ringSize + index, source + done, jmin (numThisTime, guardSize - index));
+
+                done += numThisTime;
+            }
+        }
+
+        framesWritten += numToRead;
+        publish();
+        return true;
+    }
+
+private:
+    static constexpr int frameBits = 40;
+    static constexpr uint64 frameMask = ((uint64) 1 << frameBits) - 1;
+    static constexpr uint32 generationMask = (1u << (64 - frameBits)) - 1;
+
+    void publish() noexcept
+    {
+        readProgress.store (((uint64) (servedGeneration & generationMask) << frameBits) | (uint64) framesWritten,
+                            std::memory_order_release);
+    }
+
+    AudioBuffer<float> ring;
+    int ringSize = 0;
+
+    // written by the voice
+    std::atomic<const CachedSample*> sample { nullptr };
+    std::atomic<uint32> requestedGeneration { 0 };
+    std::atomic<int64> framesConsumed { 0 };
+
+    // written by the reader: the generation in the high bits, the number of frames in the low ones
+    std::atomic<uint64> readProgress { 0 };
+
+    // only touched by the reader
+    uint32 servedGeneration = 0;
+    const CachedSample* servedSample = nullptr;
+    int64 framesWritten = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (SampleStream)
+};
+
+//==============================================================================
+/**
+    Owns one SampleStream per sampler voice, and a background thread that keeps them
+    all topped up.
+
+    The thread is the only thing that ever touches the memory-mapped files behind
+    streamed samples, so however slow the disk is, the audio thread never waits on a
+    page fault. A voice that does catch up with its stream plays silence until the
+    reader gets ahead again, and the underrun is counted.
+
+    When rendering offline there's no deadline to miss, so setNonRealtime (true) lets
+    voices wait for the reader instead.
+*/
+class SampleStreamer final : private TimeSliceClient
+{
+public:
+    static constexpr int defaultRingSize = 16384;
+    static constexpr int readSize = 4096;
+
+    SampleStreamer() = default;
+
+    ~SampleStreamer() override
+    {
+        thread.removeTimeSliceClient (this);
+        thread.stopThread (1000);
+    }
+
+    /** Makes sure there are at least numStreams streams, and starts the reader thread.
+        Call this from prepareToPlay(), never while the voices might be rendering.
+    */
+    void prepare (int numStreams, int ringSize = defaultRingSize)
+    {
+        // this waits for the reader to finish its current pass
+        thread.removeTimeSliceClient (this);
+
+        while (streams.size() < numStreams)
+            streams.add (new SampleStream());
+
+        for (auto* stream : streams)
+            if (stream->getRingSize() != ringSize)
+                stream->prepare (ringSize);
+
+        readBuffer.setSize (2, readSize);
+
+        thread.addTimeSliceClient (this);
+
+        if (! thread.isThreadRunning())
+            thread.startThread (Thread::Priority::high);
+    }
+
+    SampleStream* getStream (int index) const noexcept     { return streams[index]; }
+
+    void setNonRealtime (bool shouldBeNonRealtime) noexcept     { nonRealtime = shouldBeNonRealtime; }
+    bool isNonRealtime() const noexcept                         { return nonRealtime; }
+
+    /** Called by voices when they run out of streamed frames. */
+    void reportUnderrun() noexcept      { underruns.fetch_add (1, std::memory_order_relaxed); }
+    int getNumUnderruns() const noexcept    { return underruns.load (std::memory_order_relaxed); }
+
+private:
+    int useTimeSlice() override
+    {
+        auto anyFilled = false;
+
+        for (auto* stream : streams)
+            anyFilled = stream->fill (readBuffer) || anyFilled;
+
+        // go round again straight away while there's work to do, otherwise check back
+        // well within the time a ring takes to play
+        return anyFilled ? 0 : 2;
+    }
+
+    TimeSliceThread thread { "Sample streamer" };
+    OwnedArray<SampleStream> streams;
+    AudioBuffer<float> readBuffer;
+    std::atomic<bool> nonRealtime { false };
+    std::atomic<int> underruns { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (SampleStreamer)
+};
@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    This file contains the scratch memory arena the synth hands out to its voices.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/**
+    One block of memory, allocated up front, that temporary buffers are carved from.
+
+    prepare() does the only allocation; allocate() just bumps an offset, so it's safe
+    to call anywhere. Everything handed out stays valid until the next prepare(),
+    which is meant to be called from prepareToPlay() and throws it all away. Every
+    buffer starts on a boundary suitable for the widest SIMD loads the synth uses.
+*/
+class ScratchArena
+{
+public:
+    static constexpr size_t alignment = 32; // in bytes
+
+    ScratchArena() = default;
+
+    /** Returns how much space allocate (numFloats) will use up, including padding. */
+    static constexpr size_t getAllocationSize (size_t numFloats) noexcept
+    {
+        constexpr auto floatsPerAlignment = alignment / sizeof (float);
+        return (numFloats + floatsPerAlignment - 1) / floatsPerAlignment * floatsPerAlignment;
+    }
+
+    /** Throws away everything handed out so far and makes sure there's room for at
+        least totalNumFloats, as counted by getAllocationSize(). This allocates, so
+        never call it from the audio thread.
+    */
+    void prepare (size_t totalNumFloats)
+    {
+        if (totalNumFloats > capacity)
+        {
+            storage.allocate (totalNumFloats + alignment / sizeof (float), true);
+            capacity = totalNumFloats;
+
+            const auto address = reinterpret_cast<uintptr_t> (storage.get());
+            start = reinterpret_cast<float*> ((address + alignment - 1) & ~(uintptr_t) (alignment - 1));
+        }
+
+        used = 0;
+    }
+
+    /** Hands out a zeroed buffer of numFloats. Returns nullptr if the arena wasn't
+        prepared with enough room for it.
+    */
+    float* allocate (size_t numFloats) noexcept
+    {
+        const auto size = getAllocationSize (numFloats);
+
+        if (used + size > capacity)
+        {
+            jassertfalse; // prepare() needs to be told about this buffer too
+            return nullptr;
+        }
+
+        auto* result = start + used;
+        used += size;
+
+        std::fill (result, result + size, 0.0f);
+        return result;
+    }
+
+    size_t getCapacity() const noexcept     { return capacity; }
+    size_t getNumUsed() const noexcept      { return used; }
+
+private:
+    HeapBlock<float> storage;
+    float* start = nullptr;
+    size_t capacity = 0, used = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (ScratchArena)
+};
@@ -0,0 +1,274 @@
+/*
+  ==============================================================================
+
+    This file contains the windowed-sinc kernels used to pitch samples.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "OscillatorKernels.h"   // for the SYNTH_OSCILLATOR_USE_* instruction set checks
+
+/** How much work the sampler voices put into pitching their samples. */
+enum class ResamplingQuality
+{
+    fast,       // 8 taps: cheap enough for hundreds of voices
+    standard,   // 16 taps
+    high        // 32 taps: meant for offline renders
+};
+
+//==============================================================================
+/**
+    Precomputed polyphase tables of Kaiser-windowed sinc kernels, one set for each
+    ResamplingQuality.
+
+    Each set holds a kernel for numPhases fractional positions between two source
+    frames, and the voices interpolate between the two nearest ones, so the
+    coefficients never have to be calculated while rendering. Pitching a sample up
+    means it has to be low-pass filtered below the new Nyquist frequency as well,
+    so every set also has numBands versions of its kernel, each with a lower cutoff,
+    for successively higher pitch ratios. Like WavetableBank, the tables are built
+    once and are read-only after that, so one instance is shared by every voice.
+*/
+class SincResampler
+{
+public:
+    static constexpr int numQualities = 3;
+    static constexpr int numPhases = 256;
+    static constexpr int numBands = 12;     // band n is for pitch ratios up to 2^(n/3)
+    static constexpr int maxNumTaps = 32;
+
+    /** One band of one quality's table. A kernel reads numTaps source frames, the
+        one before the output position being the (numTaps / 2 - 1)th of them.
+    */
+    struct Kernel
+    {
+        int getHalfLength() const noexcept      { return numTaps / 2; }
+
+        const float* coefficients = nullptr;    // (numPhases + 1) rows of numTaps
+        int numTaps = 0;
+    };
+
+    SincResampler() = default;
+
+    static int getNumTaps (ResamplingQuality quality) noexcept
+    {
+        return 8 << (int) quality;
+    }
+
+    /** Builds the tables. This allocates, so call it from prepareToPlay(), never from the
+        audio thread. Does nothing if the tables have already been built.
+    */
+    void build()
+    {
+        if (isBuilt())
+            return;
+
+        for (auto quality = 0; quality < numQualities; ++quality)
+        {
+            const auto numTaps = getNumTaps ((ResamplingQuality) quality);
+            const auto halfLength = numTaps / 2;
+            const auto& design = designs[quality];
+            const auto stride = (size_t) ((numPhases + 1) * numTaps);
+
+            std::vector<float> newTable ((size_t) numBands * stride);
+
+            for (auto band = 0; band < numBands; ++band)
+            {
+                // the cutoff, as a fraction of the source's Nyquist frequency
+                const auto cutoff = design.cutoff / std::pow (2.0, band / 3.0);
+
+                for (auto phase = 0; phase <= numPhases; ++phase)
+                {
+                    auto* row = newTable.data() + (size_t) band * stride + (size_t) (phase * numTaps);
+                    const auto fraction = (double) phase / numPhases;
+                    auto sum = 0.0;
+
+                    for (auto tap = 0; tap < numTaps; ++tap)
+                    {
+                        const auto x = (double) (tap - (halfLength - 1)) - fraction;
+                        const auto value = cutoff * sinc (cutoff * x) * kaiser (x / halfLength, design.beta);
+
+                        row[tap] = (float) value;
+                        sum += value;
+                    }
+
+                    // normalising every phase keeps the gain flat at DC, so the kernel
+                    // can't add a ripple at the rate the position moves through them
+                    for (auto tap = 0; tap < numTaps; ++tap)
+                        row[tap] = (float) (row[tap] / sum);
+                }
+            }
+
+            tables[(size_t) quality] = std::move (newTable);
+        }
+    }
+
+    bool isBuilt() const noexcept       { return ! tables[0].empty(); }
+
+    /** Returns the kernel to use at a given quality for a given ratio of source
+        frames to output samples.
+    */
+    Kernel getKernel (ResamplingQuality quality, double ratio) const noexcept
+    {
+        jassert (isBuilt());
+
+        const auto numTaps = getNumTaps (quality);
+        const auto band = ratio > 1.0 ? jmin (numBands - 1, (int) std::ceil (3.0 * std::log2 (ratio))) : 0;
+        const auto stride = (size_t) ((numPhases + 1) * numTaps);
+
+        return { tables[(size_t) quality].data() + (size_t) band * stride, numTaps };
+    }
+
+    //==============================================================================
+    /** Calculates one output frame. The windows must hold kernel.numTaps frames
+        each, and fraction is the output position's distance past the frame at index
+        kernel.getHalfLength() - 1, in [0, 1).
+    */
+    static void renderFrame (const Kernel& kernel, const float* windowL, const float* windowR,
+                             float fraction, float& outL, float& outR) noexcept
+    {
+        const auto phase = fraction * (float) numPhases;
+        const auto phaseIndex = jmin ((int) phase, numPhases - 1);
+        const auto phaseFraction = phase - (float) phaseIndex;
+
+        const auto* row0 = kernel.coefficients + phaseIndex * kernel.numTaps;
+        const auto* row1 = row0 + kernel.numTaps;
+        const auto numTaps = kernel.numTaps;
+
+       #if SYNTH_OSCILLATOR_USE_AVX2
+        const auto alpha = _mm256_set1_ps (phaseFraction);
+        auto sumL = _mm256_setzero_ps(), sumR = _mm256_setzero_ps();
+
+        for (auto i = 0; i < numTaps; i += 8)
+        {
+            const auto c0 = _mm256_loadu_ps (row0 + i);
+            const auto c = _mm256_add_ps (c0, _mm256_mul_ps (alpha, _mm256_sub_ps (_mm256_loadu_ps (row1 + i), c0)));
+
+            sumL = _mm256_add_ps (sumL, _mm256_mul_ps (c, _mm256_loadu_ps (windowL + i)));
+            sumR = _mm256_add_ps (sumR, _mm256_mul_ps (c, _mm256_loadu_ps (windowR + i)));
+        }
+
+        outL = addLanes (_mm_add_ps (_mm256_castps256_ps128 (sumL), _mm256_extractf128_ps (sumL, 1)));
+        outR = addLanes (_mm_add_ps (_mm256_castps256_ps128 (sumR), _mm256_extractf128_ps (sumR, 1)));
+       #elif SYNTH_OSCILLATOR_USE_SSE2
+        const auto alpha = _mm_set1_ps (phaseFraction);
+        auto sumL = _mm_setzero_ps(), sumR = _mm_setzero_ps();
+
+        for (auto i = 0; i < numTaps; i += 4)
+        {
+            const auto c0 = _mm_loadu_ps (row0 + i);
+            const auto c = _mm_add_ps (c0, _mm_mul_ps (alpha, _mm_sub_ps (_mm_loadu_ps (row1 + i), c0)));
+
+            sumL = _mm_add_ps (sumL, _mm_mul_ps (c, _mm_loadu_ps (windowL + i)));
+            sumR = _mm_add_ps (sumR, _mm_mul_ps (c, _mm_loadu_ps (windowR + i)));
+        }
+
+        outL = addLanes (sumL);
+        outR = addLanes (sumR);
+       #elif SYNTH_OSCILLATOR_USE_NEON
+        const auto alpha = vdupq_n_f32 (phaseFraction);
+        auto sumL = vdupq_n_f32 (0.0f), sumR = vdupq_n_f32 (0.0f);
+
+        for (auto i = 0; i < numTaps; i += 4)
+        {
+            const auto c0 = vld1q_f32 (row0 + i);
+            const auto c = vmlaq_f32 (c0, alpha, vsubq_f32 (vld1q_f32 (row1 + i), c0));
+
+            sumL = vmlaq_f32 (sumL, c, vld1q_f32 (windowL + i));
+            sumR = vmlaq_f32 (sumR, c, vld1q_f32 (windowR + i));
+        }
+
+        const auto pairL = vadd_f32 (vget_low_f32 (sumL), vget_high_f32 (sumL));
+        const auto pairR = vadd_f32 (vget_low_f32 (sumR), vget_high_f32 (sumR));
+        outL = vget_lane_f32 (vpadd_f32 (pairL, pairL), 0);
+        outR = vget_lane_f32 (vpadd_f32 (pairR, pairR), 0);
+       #else
+        auto sumL = 0.0f, sumR = 0.0f;
+
+        for (auto i = 0; i < numTaps; ++i)
+        {
+            const auto c = row0[i] + phaseFraction * (row1[i] - row0[i]);
+            sumL += c * windowL[i];
+            sumR += c * windowR[i];
+        }
+
+        outL = sumL;
+        outR = sumR;
+       #endif
+    }
+
+    /** Like renderFrame(), but for an output position near either end of a block of
+        numFrames source frames, which are treated as silent outside the block.
+        position is the frame just before the output position.
+    */
+    static void renderFrameAtEdge (const Kernel& kernel, const float* sourceL, const float* sourceR, int64 numFrames,
+                                   int64 position, float fraction, float& outL, float& outR) noexcept
+    {
+        float windowL[maxNumTaps], windowR[maxNumTaps];
+        const auto first = position - (kernel.getHalfLength() - 1);
+
+        for (auto i = 0; i < kernel.numTaps; ++i)
+        {
+            const auto frame = first + i;
+            const auto isInside = frame >= 0 && frame < numFrames;
+            windowL[i] = isInside ? sourceL[frame] : 0.0f;
+            windowR[i] = isInside ? sourceR[frame] : 0.0f;
+        }
+
+        renderFrame (kernel, windowL, windowR, fraction, outL, outR);
+    }
+
+private:
+    struct Design
+    {
+        double cutoff;  // as a fraction of Nyquist, leaving room for the transition band
+        double beta;    // the Kaiser window's shape; higher trades a wider transition for a deeper stopband
+    };
+
+    static constexpr Design designs[numQualities] { { 0.80, 5.0 }, { 0.88, 7.0 }, { 0.93, 9.0 } };
+
+    static double sinc (double x) noexcept
+    {
+        if (std::abs (x) < 1.0e-9)
+            return 1.0;
+
+        const auto phase = MathConstants<double>::pi * x;
+        return std::sin (phase) / phase;
+    }
+
+    /** A Kaiser window, for x in [-1, 1]. */
+    static double kaiser (double x, double beta) noexcept
+    {
+        if (std::abs (x) > 1.0)
+            return 0.0;
+
+        return besselI0 (beta * std::sqrt (1.0 - x * x)) / besselI0 (beta);
+    }
+
+    static double besselI0 (double x) noexcept
+    {
+        auto sum = 1.0, term = 1.0;
+
+        for (auto k = 1; k < 32; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+   #if SYNTH_OSCILLATOR_USE_AVX2 || SYNTH_OSCILLATOR_USE_SSE2
+    static float addLanes (__m128 v) noexcept
+    {
+        const auto pairs = _mm_add_ps (v, _mm_movehl_ps (v, v));
+        return _mm_cvtss_f32 (_mm_add_ss (pairs, _mm_shuffle_ps (pairs, pairs, 1)));
+    }
+   #endif
+
+    std::array<std::vector<float>, numQualities> tables;
+
+    JUCE_DECLARE_NON_COPYABLE (SincResampler)
+};
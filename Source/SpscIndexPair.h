@@ -0,0 +1,80 @@
+/*
+  ==============================================================================
+
+    This file contains the index pair shared by the synth's lock-free rings.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/**
+    The read and write positions of a wait-free, single-producer, single-consumer
+    ring of a fixed, power-of-two capacity. The ring's storage belongs to whoever
+    uses this; wrap() turns a position into an index into it.
+
+    The positions only ever increase, wrapping around at 2^32, so a full ring and
+    an empty one can be told apart without giving up a slot. Each side owns one,
+    on its own cache line, so the producer and consumer don't fight over them.
+
+    The producer writes its items at getWriteIndex() onwards, then publishes them
+    with finishedWrite(); the consumer reads them from getReadIndex() onwards, then
+    hands the space back with finishedRead(). AbstractFifo does much the same, but
+    keeps both positions on one cache line and always leaves a slot empty.
+*/
+template <int capacity>
+class SpscIndexPair
+{
+public:
+    SpscIndexPair() = default;
+
+    /** Returns the ring index of a position. */
+    static int wrap (uint32 position) noexcept          { return (int) (position & (uint32) (capacity - 1)); }
+
+    //==============================================================================
+    /** Producer: the position of the next item to write. */
+    uint32 getWriteIndex() const noexcept               { return writeIndex.load (std::memory_order_relaxed); }
+
+    /** Producer: how many items there's room to write. */
+    int getFreeSpace() const noexcept
+    {
+        return capacity - (int) (writeIndex.load (std::memory_order_relaxed) - readIndex.load (std::memory_order_acquire));
+    }
+
+    /** Producer: makes numItems, written from getWriteIndex() onwards, visible to the consumer. */
+    void finishedWrite (int numItems) noexcept
+    {
+        writeIndex.store (writeIndex.load (std::memory_order_relaxed) + (uint32) numItems, std::memory_order_release);
+    }
+
+    //==============================================================================
+    /** Consumer: the position of the next item to read. */
+    uint32 getReadIndex() const noexcept                { return readIndex.load (std::memory_order_relaxed); }
+
+    /** Consumer: how many items are waiting to be read. */
+    int getNumReady() const noexcept
+    {
+        return (int) (writeIndex.load (std::memory_order_acquire) - readIndex.load (std::memory_order_relaxed));
+    }
+
+    /** Consumer: hands the space used by numItems back to the producer. */
+    void finishedRead (int numItems) noexcept
+    {
+        readIndex.store (readIndex.load (std::memory_order_relaxed) + (uint32) numItems, std::memory_order_release);
+    }
+
+    /** Consumer: throws away everything that's waiting to be read. */
+    void discardAll() noexcept
+    {
+        readIndex.store (writeIndex.load (std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    alignas (64) std::atomic<uint32> writeIndex { 0 };
+    alignas (64) std::atomic<uint32> readIndex { 0 };
+
+    static_assert (isPowerOfTwo (capacity), "The positions wrap with a mask");
+
+    JUCE_DECLARE_NON_COPYABLE (SpscIndexPair)
+};
@@ -0,0 +1,198 @@
+/*
+  ==============================================================================
+
+    This file contains the state-variable filter used by the voices, and the
+    tabulated prewarp it works out its coefficients with.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/** The responses the state-variable filter can produce. */
+enum class FilterType
+{
+    lowPass,
+    highPass,
+    bandPass,   // normalised, so its peak is at unity gain whatever the Q
+    notch
+};
+
+//==============================================================================
+/**
+    The coefficients of a topology-preserving (zero-delay feedback) state-variable
+    filter, after Andrew Simper's trapezoidal SVF.
+
+    The filter's integrators are trapezoidal, and its feedback is solved for exactly
+    each sample, so unlike a biquad its state keeps the same meaning whatever the
+    coefficients are. That makes it stable however fast the cutoff moves, even if
+    it jumps to a new value every sample, as long as g and k are positive.
+
+    Working out a set costs one table lookup and one division, against the tan(),
+    several divisions and five coefficients of a biquad, so it's cheap enough to
+    do at control rate for every voice. The response is picked by mixing the input
+    and the two states, which keeps the inner loop free of branches.
+*/
+struct SvfCoefficients
+{
+    // the highest cutoff, as a fraction of the sample rate, that the table covers
+    static constexpr float maxNormalisedFrequency = 0.49f;
+
+    /** Returns tan (pi * f / fs), the filter's prewarped integrator gain, for a cutoff
+        given as a fraction of the sample rate. It's looked up in a table spaced
+        evenly in frequency, with linear interpolation, which keeps it within a few
+        cents of the exact cutoff right up to the top of the range.
+    */
+    static float getPrewarpedGain (float normalisedFrequency) noexcept
+    {
+        const auto position = jlimit (0.0f, maxNormalisedFrequency, normalisedFrequency) * tableScale;
+        const auto index = (int) position;
+        const auto fraction = position - (float) index;
+
+        return tanTable[(size_t) index] + fraction * (tanTable[(size_t) index + 1] - tanTable[(size_t) index]);
+    }
+
+    /** Sets up the filter for a cutoff given as a fraction of the sample rate. */
+    void set (FilterType type, float normalisedFrequency, float q) noexcept
+    {
+        const auto g = getPrewarpedGain (jmax (1.0e-5f, normalisedFrequency));
+        const auto k = 1.0f / jmax (0.1f, q);
+
+        a1 = 1.0f / (1.0f + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+
+        switch (type)
+        {
+            case FilterType::highPass:  m0 = 1.0f; m1 = -k;   m2 = -1.0f; break;
+            case FilterType::bandPass:  m0 = 0.0f; m1 = k;    m2 = 0.0f;  break;
+            case FilterType::notch:     m0 = 1.0f; m1 = -k;   m2 = 0.0f;  break;
+            case FilterType::lowPass:
+            default:                    m0 = 0.0f; m1 = 0.0f; m2 = 1.0f;  break;
+        }
+    }
+
+    float a1 = 1.0f, a2 = 0.0f, a3 = 0.0f;  // the solved feedback
+    float m0 = 0.0f, m1 = 0.0f, m2 = 1.0f;  // how much of the input, band and low outputs to mix
+
+private:
+    static constexpr int tableSize = 4096;
+    static constexpr float tableScale = (float) tableSize / maxNormalisedFrequency;
+
+    static std::array<float, tableSize + 2> makeTanTable() noexcept
+    {
+        std::array<float, tableSize + 2> table {};
+
+        for (size_t i = 0; i < table.size(); ++i)
+            table[i] = (float) std::tan (MathConstants<double>::pi * (double) i / (double) tableScale);
+
+        return table;
+    }
+
+    // filled in before main() runs, so the audio thread never has to build it
+    static inline const std::array<float, tableSize + 2> tanTable = makeTanTable();
+};
+
+//==============================================================================
+/**
+    The two integrator states of a state-variable filter, which works on floats or
+    on dsp::SIMDRegisters holding one filter per lane.
+
+    The coefficients are passed in as the same type as the samples, so that a
+    register's worth of filters can each have their own.
+*/
+template <typename SampleType>
+struct SvfState
+{
+    SampleType process (SampleType input, SampleType a1, SampleType a2, SampleType a3,
+                        SampleType m0, SampleType m1, SampleType m2) noexcept
+    {
+        const auto v3 = input - ic2eq;
+        const auto v1 = a1 * ic1eq + a2 * v3;
+        const auto v2 = ic2eq + a2 * ic1eq + a3 * v3;
+
+        ic1eq = v1 + v1 - ic1eq;
+        ic2eq = v2 + v2 - ic2eq;
+
+        return m0 * input + m1 * v1 + m2 * v2;
+    }
+
+    void reset() noexcept
+    {
+        ic1eq = {};
+        ic2eq = {};
+    }
+
+    SampleType ic1eq {}, ic2eq {};
+};
+
+//==============================================================================
+/**
+    A multi-channel state-variable filter, for filtering a whole mix.
+
+    The cutoff can be changed as often as every sample, e.g. from an audio-rate
+    modulator, because setting it is cheap and the filter stays stable however fast
+    it moves.
+*/
+class StateVariableFilter
+{
+public:
+    StateVariableFilter() = default;
+
+    void prepare (double newSampleRate, int numChannels)
+    {
+        jassert (newSampleRate > 0.0);
+        sampleRate = newSampleRate;
+        states.resize ((size_t) numChannels);
+        reset();
+        update();
+    }
+
+    void reset() noexcept
+    {
+        for (auto& state : states)
+            state.reset();
+    }
+
+    void setType (FilterType newType) noexcept              { type = newType; update(); }
+    void setCutoffFrequency (float newFrequency) noexcept   { cutoff = newFrequency; update(); }
+    void setResonance (float newQ) noexcept                 { resonance = newQ; update(); }
+
+    float processSample (int channel, float input) noexcept
+    {
+        return states[(size_t) channel].process (input, coefficients.a1, coefficients.a2, coefficients.a3,
+                                                 coefficients.m0, coefficients.m1, coefficients.m2);
+    }
+
+    /** Filters every channel of a buffer in place, at the current settings. Channels
+        past the number it was prepared for are left alone.
+    */
+    void process (AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept
+    {
+        const auto numChannels = jmin (buffer.getNumChannels(), (int) states.size());
+        jassert (numChannels == buffer.getNumChannels());
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            auto* data = buffer.getWritePointer (channel, startSample);
+
+            for (auto i = 0; i < numSamples; ++i)
+                data[i] = processSample (channel, data[i]);
+        }
+    }
+
+private:
+    void update() noexcept
+    {
+        coefficients.set (type, (float) (cutoff / sampleRate), resonance);
+    }
+
+    double sampleRate = 44100.0;
+    FilterType type = FilterType::lowPass;
+    float cutoff = 1000.0f, resonance = 0.7f;
+    SvfCoefficients coefficients;
+    std::vector<SvfState<float>> states;
+
+    JUCE_DECLARE_NON_COPYABLE (StateVariableFilter)
+};
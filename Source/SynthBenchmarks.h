@@ -0,0 +1,656 @@
+/*
+  ==============================================================================
+
+    This file contains the microbenchmarks for the synth's kernels: the
+    oscillators, envelopes, filters, sampler and mixer, and the whole synth.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "AudioSynthesiserDemo.h"
+
+//==============================================================================
+/** Which benchmarks to run, and at which sizes. Every case runs at every combination. */
+struct BenchmarkSettings
+{
+    Array<int> voiceCounts      { 1, 16, 64 };
+    Array<int> blockSizes       { 16, 64, 256, 1024, 2048 };
+    Array<double> sampleRates   { 48000.0 };
+
+    StringArray cases;              // the cases to run; leave it empty to run them all
+    double secondsPerTrial = 0.1;   // each trial renders blocks for at least this long
+    int numTrials = 5;              // the median of these is reported
+};
+
+//==============================================================================
+/** The timing of one case at one size. Times are in nanoseconds. */
+struct BenchmarkResult
+{
+    String caseName;
+    int numVoices = 0, blockSize = 0;
+    double sampleRate = 0.0;
+
+    double nsPerSample = 0.0;       // per sample of output, whatever the number of voices
+    double nsPerVoiceSample = 0.0;  // per sample of each voice, for the cases that have voices
+    double voicesPerCore = 0.0;     // how many voices one core could render in realtime, for those cases
+    double realtimeFactor = 0.0;    // how many times faster than realtime the whole case ran
+};
+
+//==============================================================================
+/**
+    Times the building blocks of the synth in isolation, and the synth as a whole.
+
+    Each case is set up from scratch for each voice count, block size and sample
+    rate, then renders blocks in a loop: a few to warm up, and then several
+    trials that each last at least BenchmarkSettings::secondsPerTrial. Notes are
+    restarted once a second of audio, so the voices are never all sitting in
+    their sustain or run off the end of a sample, however fast they render.
+
+    The cases are:
+    - oscillator-sine/square/saw/triangle: SineWaveVoices mixed straight into the
+      output, with their envelopes and modulation
+    - envelope-linear/exponential: the voices' BlockEnvelope, filling gain curves
+    - adsr: juce::ADSR, a sample at a time, for comparison
+    - filter-bank: the voices' VoiceFilterBank, which filters them in SIMD lanes
+    - filter-scalar: one StateVariableFilter per voice, for comparison
+    - sampler-fast/standard/high: CachedSamplerVoices playing a resident sample
+    - mixer: mixing each voice's block into a stereo output
+    - synth: SynthAudioSource with a note held for every voice, including the
+      filters and the output gain. The synth has at most maxNumVoices voices, and
+      the results give the number it really played
+    - dispatch: SynthAudioSource with a pool of voices and a note starting and
+      another stopping every 32 samples, which is mostly the cost of handling the
+      MIDI and finding voices
+*/
+class SynthBenchmarks
+{
+public:
+    explicit SynthBenchmarks (const BenchmarkSettings& settingsToUse)
+        : settings (settingsToUse)
+    {
+        wavetables.build();
+        resampler.build();
+    }
+
+    static StringArray getCaseNames()
+    {
+        return { "oscillator-sine", "oscillator-square", "oscillator-saw", "oscillator-triangle",
+                 "envelope-linear", "envelope-exponential", "adsr",
+                 "filter-bank", "filter-scalar",
+                 "sampler-fast", "sampler-standard", "sampler-high",
+                 "mixer", "synth", "dispatch" };
+    }
+
+    /** Runs the cases, calling onResult as each one finishes. Returns an error if a
+        case that was asked for doesn't exist.
+    */
+    Result run (std::vector<BenchmarkResult>& results, std::function<void (const BenchmarkResult&)> onResult = {})
+    {
+        const auto allCases = getCaseNames();
+        const auto casesToRun = settings.cases.isEmpty() ? allCases : settings.cases;
+
+        for (const auto& name : casesToRun)
+            if (! allCases.contains (name))
+                return Result::fail ("Unknown benchmark: " + name);
+
+        ScopedNoDenormals noDenormals;
+
+        for (const auto& name : casesToRun)
+        {
+            for (auto sampleRate : settings.sampleRates)
+            {
+                for (auto blockSize : settings.blockSizes)
+                {
+                    for (auto numVoices : settings.voiceCounts)
+                    {
+                        auto fixture = createFixture (name, { numVoices, blockSize, sampleRate });
+
+                        // report the voices the case really played, so the per-voice figures are right
+                        const auto numVoicesPlayed = jmin (numVoices, fixture->maxNumVoices);
+
+                        BenchmarkResult result;
+                        result.caseName = name;
+                        result.numVoices = numVoicesPlayed;
+                        result.blockSize = blockSize;
+                        result.sampleRate = sampleRate;
+                        result.nsPerSample = measure (*fixture, blockSize, sampleRate);
+
+                        const auto budget = 1.0e9 / sampleRate;
+                        result.realtimeFactor = budget / result.nsPerSample;
+
+                        if (fixture->hasVoices)
+                        {
+                            result.nsPerVoiceSample = result.nsPerSample / numVoicesPlayed;
+                            result.voicesPerCore = budget / result.nsPerVoiceSample;
+                        }
+
+                        results.push_back (result);
+
+                        if (onResult != nullptr)
+                            onResult (result);
+                    }
+                }
+            }
+        }
+
+        return Result::ok();
+    }
+
+    /** Returns the results as a JSON document, labelled e.g. with the commit they're for. */
+    static String toJson (const std::vector<BenchmarkResult>& results, const String& label)
+    {
+        auto* document = new DynamicObject();
+        document->setProperty ("label", label);
+        document->setProperty ("cpu", SystemStats::getCpuModel());
+        document->setProperty ("num_cpus", SystemStats::getNumCpus());
+        document->setProperty ("simd", getInstructionSetName());
+       #if JUCE_DEBUG
+        document->setProperty ("config", "debug");
+       #else
+        document->setProperty ("config", "release");
+       #endif
+
+        Array<var> entries;
+
+        for (const auto& result : results)
+        {
+            auto* entry = new DynamicObject();
+            entry->setProperty ("case", result.caseName);
+            entry->setProperty ("voices", result.numVoices);
+            entry->setProperty ("block_size", result.blockSize);
+            entry->setProperty ("sample_rate", result.sampleRate);
+            entry->setProperty ("ns_per_sample", result.nsPerSample);
+            entry->setProperty ("realtime_factor", result.realtimeFactor);
+
+            if (result.nsPerVoiceSample > 0.0)
+            {
+                entry->setProperty ("ns_per_voice_sample", result.nsPerVoiceSample);
+                entry->setProperty ("voices_per_core", result.voicesPerCore);
+            }
+
+            entries.add (var (entry));
+        }
+
+        document->setProperty ("results", entries);
+        return JSON::toString (var (document));
+    }
+
+    static const char* getInstructionSetName() noexcept
+    {
+       #if SYNTH_OSCILLATOR_USE_AVX2
+        return "avx2";
+       #elif SYNTH_OSCILLATOR_USE_SSE2
+        return "sse2";
+       #elif SYNTH_OSCILLATOR_USE_NEON
+        return "neon";
+       #else
+        return "scalar";
+       #endif
+    }
+
+private:
+    struct Size
+    {
+        int numVoices, blockSize;
+        double sampleRate;
+    };
+
+    /** One case, set up at one size. */
+    struct Fixture
+    {
+        virtual ~Fixture() = default;
+
+        /** Renders one block. */
+        virtual void renderBlock() = 0;
+
+        /** Starts every voice again from the beginning of its note. */
+        virtual void restart() {}
+
+        bool hasVoices = true;
+        int maxNumVoices = std::numeric_limits<int>::max();    // more voices than this can't be asked for
+    };
+
+    //==============================================================================
+    /** The MIDI note, and channel, for each voice, so that up to 16 * 64 notes can be
+        held at once without any two being the same.
+    */
+    static int getNoteFor (int voice) noexcept      { return 36 + voice % 64; }
+    static int getChannelFor (int voice) noexcept   { return 1 + (voice / 64) % 16; }
+
+    /** A block of noise for the cases that need something to process. */
+    static std::vector<float> makeNoise (int numSamples, int64 seed)
+    {
+        Random random (seed);
+        std::vector<float> noise ((size_t) numSamples);
+
+        for (auto& sample : noise)
+            sample = random.nextFloat() * 0.5f - 0.25f;
+
+        return noise;
+    }
+
+    //==============================================================================
+    struct OscillatorFixture final : public Fixture
+    {
+        OscillatorFixture (const WavetableBank& wavetables, WavetableBank::Waveform waveform, Size size)
+            : buffer (2, size.blockSize), blockSize (size.blockSize)
+        {
+            parameters.update ([waveform] (SynthParameters& p)
+            {
+                p.waveform = waveform;
+                p.envelope = { 0.01f, 0.5f, 0.7f, 0.5f };
+            });
+
+            parameters.pull();
+            arena.prepare ((size_t) size.numVoices * SineWaveVoice::getScratchSizeNeeded (size.blockSize));
+
+            for (auto i = 0; i < size.numVoices; ++i)
+            {
+                auto* voice = voices.add (new SineWaveVoice());
+                voice->setCurrentPlaybackSampleRate (size.sampleRate);
+                voice->setADSRSampleRate (size.sampleRate);
+                voice->setWavetables (&wavetables);
+                voice->setParameterStore (&parameters);
+                voice->prepareScratch (arena, size.blockSize);
+            }
+
+            restart();
+        }
+
+        void renderBlock() override
+        {
+            buffer.clear();
+
+            for (auto* voice : voices)
+                voice->renderNextBlock (buffer, 0, blockSize);
+        }
+
+        void restart() override
+        {
+            for (auto i = 0; i < voices.size(); ++i)
+                voices[i]->startNote (getNoteFor (i), 0.8f, sound.get(), 8192);
+        }
+
+        SynthParameterStore parameters;
+        ScratchArena arena;
+        ReferenceCountedObjectPtr<SineWaveSound> sound { new SineWaveSound() };
+        OwnedArray<SineWaveVoice> voices;
+        AudioBuffer<float> buffer;
+        int blockSize;
+    };
+
+    //==============================================================================
+    struct EnvelopeFixture final : public Fixture
+    {
+        EnvelopeFixture (BlockEnvelope::Curve curve, Size size)
+            : envelopes ((size_t) size.numVoices), curves ((size_t) size.numVoices),
+              blockSize (size.blockSize), releasePosition ((int) (size.sampleRate / 2))
+        {
+            for (size_t i = 0; i < envelopes.size(); ++i)
+            {
+                // the segments are short enough that most of the time isn't spent sustaining
+                envelopes[i].setSampleRate (size.sampleRate);
+                envelopes[i].setParameters ({ 0.05f, 0.3f, 0.5f, 0.3f });
+                envelopes[i].setCurve (curve);
+                curves[i].resize ((size_t) blockSize);
+            }
+
+            restart();
+        }
+
+        void renderBlock() override
+        {
+            // the notes are released half way through each second
+            const auto shouldRelease = position < releasePosition && position + blockSize >= releasePosition;
+            position += blockSize;
+
+            for (size_t i = 0; i < envelopes.size(); ++i)
+            {
+                if (shouldRelease)
+                    envelopes[i].noteOff();
+
+                envelopes[i].fillGainCurve (curves[i].data(), blockSize);
+            }
+        }
+
+        void restart() override
+        {
+            position = 0;
+
+            for (auto& envelope : envelopes)
+                envelope.noteOn();
+        }
+
+        std::vector<BlockEnvelope> envelopes;
+        std::vector<std::vector<float>> curves;
+        int blockSize, releasePosition, position = 0;
+    };
+
+    struct AdsrFixture final : public Fixture
+    {
+        explicit AdsrFixture (Size size)
+            : envelopes ((size_t) size.numVoices), curve ((size_t) size.blockSize)
+        {
+            for (auto& envelope : envelopes)
+            {
+                envelope.setSampleRate (size.sampleRate);
+                envelope.setParameters ({ 0.05f, 0.3f, 0.5f, 0.3f });
+            }
+
+            restart();
+        }
+
+        void renderBlock() override
+        {
+            for (auto& envelope : envelopes)
+                for (auto& sample : curve)
+                    sample = envelope.getNextSample();
+        }
+
+        void restart() override
+        {
+            for (auto& envelope : envelopes)
+                envelope.noteOn();
+        }
+
+        std::vector<ADSR> envelopes;
+        std::vector<float> curve;
+    };
+
+    //==============================================================================
+    struct FilterBankFixture final : public Fixture
+    {
+        explicit FilterBankFixture (Size size)
+            : buffer (2, size.blockSize), input (makeNoise (size.blockSize, 1)),
+              numVoices (size.numVoices), blockSize (size.blockSize)
+        {
+            bank.prepare (numVoices, blockSize, size.sampleRate);
+            cutoff.reset (size.sampleRate, 0.05);
+            cutoff.setCurrentAndTargetValue (1000.0f);
+            resonance.reset (size.sampleRate, 0.05);
+            resonance.setCurrentAndTargetValue (2.0f);
+        }
+
+        void renderBlock() override
+        {
+            buffer.clear();
+            bank.beginBlock (0, blockSize);
+
+            for (auto slot = 0; slot < numVoices; ++slot)
+            {
+                // each voice moves its own cutoff at control rate, as the real ones do
+                for (auto offset = 0; offset < blockSize; offset += VoiceModulator::controlInterval)
+                    bank.setCutoffScale (slot, offset, jmin (VoiceModulator::controlInterval, blockSize - offset),
+                                         1.0f + 0.01f * (float) ((slot + offset) % 16));
+
+                bank.addInput (slot, 0, input.data(), 0.1f, blockSize);
+            }
+
+            bank.endBlock (buffer, FilterType::lowPass, 1.0f, cutoff, resonance);
+        }
+
+        VoiceFilterBank bank;
+        AudioBuffer<float> buffer;
+        std::vector<float> input;
+        SmoothedValue<float, ValueSmoothingTypes::Multiplicative> cutoff { 1000.0f };
+        SmoothedValue<float> resonance { 2.0f };
+        int numVoices, blockSize;
+    };
+
+    struct ScalarFilterFixture final : public Fixture
+    {
+        explicit ScalarFilterFixture (Size size)
+            : filters ((size_t) size.numVoices), input (makeNoise (size.blockSize, 1)),
+              output ((size_t) size.blockSize), blockSize (size.blockSize)
+        {
+            for (auto& filter : filters)
+            {
+                filter = std::make_unique<StateVariableFilter>();
+                filter->prepare (size.sampleRate, 1);
+                filter->setResonance (2.0f);
+            }
+        }
+
+        void renderBlock() override
+        {
+            std::fill (output.begin(), output.end(), 0.0f);
+
+            for (size_t i = 0; i < filters.size(); ++i)
+            {
+                auto& filter = *filters[i];
+
+                for (auto offset = 0; offset < blockSize; offset += VoiceModulator::controlInterval)
+                {
+                    filter.setCutoffFrequency (1000.0f * (1.0f + 0.01f * (float) ((i + (size_t) offset) % 16)));
+
+                    for (auto n = offset; n < jmin (blockSize, offset + VoiceModulator::controlInterval); ++n)
+                        output[(size_t) n] += filter.processSample (0, input[(size_t) n]);
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<StateVariableFilter>> filters;
+        std::vector<float> input, output;
+        int blockSize;
+    };
+
+    //==============================================================================
+    struct SamplerFixture final : public Fixture
+    {
+        SamplerFixture (const SincResampler& resampler, ResamplingQuality quality, Size size)
+            : buffer (2, size.blockSize), blockSize (size.blockSize)
+        {
+            // ten seconds of noise is enough for any note to play for a second
+            constexpr auto lengthInSeconds = 10.0;
+            sample.sampleRate = size.sampleRate;
+            sample.lengthInSamples = (int64) (lengthInSeconds * size.sampleRate);
+            sample.data.setSize (2, (int) sample.lengthInSamples);
+
+            for (auto channel = 0; channel < 2; ++channel)
+            {
+                const auto noise = makeNoise ((int) sample.lengthInSamples, channel + 1);
+                sample.data.copyFrom (channel, 0, noise.data(), (int) noise.size());
+            }
+
+            sound->setSample (&sample, 60);
+            parameters.update ([quality] (SynthParameters& p) { p.resamplingQuality = quality; });
+            parameters.pull();
+            arena.prepare ((size_t) size.numVoices * CachedSamplerVoice::getScratchSizeNeeded (size.blockSize));
+
+            for (auto i = 0; i < size.numVoices; ++i)
+            {
+                auto* voice = voices.add (new CachedSamplerVoice());
+                voice->setCurrentPlaybackSampleRate (size.sampleRate);
+                voice->setResampler (&resampler);
+                voice->setParameterStore (&parameters);
+                voice->prepareScratch (arena, size.blockSize);
+            }
+
+            restart();
+        }
+
+        void renderBlock() override
+        {
+            buffer.clear();
+
+            for (auto* voice : voices)
+                voice->renderNextBlock (buffer, 0, blockSize);
+        }
+
+        void restart() override
+        {
+            // the notes span an octave either side of the root, so most of them are resampled
+            for (auto i = 0; i < voices.size(); ++i)
+                voices[i]->startNote (48 + (i * 5) % 25, 0.8f, sound.get(), 8192);
+        }
+
+        CachedSample sample;
+        SynthParameterStore parameters;
+        ScratchArena arena;
+        ReferenceCountedObjectPtr<CachedSamplerSound> sound { new CachedSamplerSound() };
+        OwnedArray<CachedSamplerVoice> voices;
+        AudioBuffer<float> buffer;
+        int blockSize;
+    };
+
+    //==============================================================================
+    struct MixerFixture final : public Fixture
+    {
+        explicit MixerFixture (Size size)
+            : buffer (2, size.blockSize), blockSize (size.blockSize)
+        {
+            for (auto i = 0; i < size.numVoices; ++i)
+                voiceBlocks.push_back (makeNoise (blockSize, i + 1));
+        }
+
+        void renderBlock() override
+        {
+            buffer.clear();
+
+            for (auto& block : voiceBlocks)
+                for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+                    FloatVectorOperations::addWithMultiply (buffer.getWritePointer (channel), block.data(), 0.1f, blockSize);
+        }
+
+        AudioBuffer<float> buffer;
+        std::vector<std::vector<float>> voiceBlocks;
+        int blockSize;
+    };
+
+    //==============================================================================
+    struct SynthFixture final : public Fixture
+    {
+        SynthFixture (Size size, bool dispatchOnly)
+            : source (keyboardState, jmax (SynthAudioSource::minNumVoices, size.numVoices)),
+              buffer (2, size.blockSize), numVoices (jmin (size.numVoices, source.getNumVoices())), blockSize (size.blockSize),
+              isDispatch (dispatchOnly)
+        {
+            source.setUsingSineWaveSound();
+            source.setWaveType (SineWaveVoice::Sawtooth);
+            source.setEnvelopeParameters (isDispatch ? ADSR::Parameters { 0.001f, 0.05f, 0.5f, 0.02f }
+                                                     : ADSR::Parameters { 0.01f, 0.5f, 0.7f, 0.5f });
+            source.prepareToPlay (blockSize, size.sampleRate);
+            midi.ensureSize (SynthAudioSource::midiBufferSize);
+
+            // the dispatch case's pool size isn't how many voices are playing
+            hasVoices = ! isDispatch;
+            maxNumVoices = source.getNumVoices();
+            restart();
+        }
+
+        void renderBlock() override
+        {
+            if (isDispatch)
+            {
+                for (auto position = 0; position < blockSize; position += eventInterval)
+                {
+                    midi.addEvent (MidiMessage::noteOff (1, 36 + (nextNote + 64 - notesHeld) % 64), position);
+                    midi.addEvent (MidiMessage::noteOn (1, 36 + nextNote, (uint8) 100), position);
+                    nextNote = (nextNote + 1) % 64;
+                }
+            }
+
+            buffer.clear();
+            source.renderNextBlock (buffer, midi, 0, blockSize);
+            midi.clear();
+        }
+
+        void restart() override
+        {
+            if (isDispatch)
+                return;
+
+            // the voice playing each note is released, and the new note-on takes another one,
+            // stealing when the pool is full, so each restart includes the releases and steals
+            for (auto i = 0; i < numVoices; ++i)
+                midi.addEvent (MidiMessage::noteOn (getChannelFor (i), getNoteFor (i), (uint8) 100), 0);
+        }
+
+        static constexpr int eventInterval = 32, notesHeld = 8;
+
+        MidiKeyboardState keyboardState;
+        SynthAudioSource source;
+        AudioBuffer<float> buffer;
+        MidiBuffer midi;
+        int numVoices, blockSize, nextNote = 0;
+        bool isDispatch;
+    };
+
+    //==============================================================================
+    std::unique_ptr<Fixture> createFixture (const String& name, Size size) const
+    {
+        std::unique_ptr<Fixture> fixture;
+
+        if      (name == "oscillator-sine")         fixture = std::make_unique<OscillatorFixture> (wavetables, WavetableBank::sine, size);
+        else if (name == "oscillator-square")       fixture = std::make_unique<OscillatorFixture> (wavetables, WavetableBank::square, size);
+        else if (name == "oscillator-saw")          fixture = std::make_unique<OscillatorFixture> (wavetables, WavetableBank::sawtooth, size);
+        else if (name == "oscillator-triangle")     fixture = std::make_unique<OscillatorFixture> (wavetables, WavetableBank::triangle, size);
+        else if (name == "envelope-linear")         fixture = std::make_unique<EnvelopeFixture> (BlockEnvelope::Curve::linear, size);
+        else if (name == "envelope-exponential")    fixture = std::make_unique<EnvelopeFixture> (BlockEnvelope::Curve::exponential, size);
+        else if (name == "adsr")                    fixture = std::make_unique<AdsrFixture> (size);
+        else if (name == "filter-bank")             fixture = std::make_unique<FilterBankFixture> (size);
+        else if (name == "filter-scalar")           fixture = std::make_unique<ScalarFilterFixture> (size);
+        else if (name == "sampler-fast")            fixture = std::make_unique<SamplerFixture> (resampler, ResamplingQuality::fast, size);
+        else if (name == "sampler-standard")        fixture = std::make_unique<SamplerFixture> (resampler, ResamplingQuality::standard, size);
+        else if (name == "sampler-high")            fixture = std::make_unique<SamplerFixture> (resampler, ResamplingQuality::high, size);
+        else if (name == "mixer")                   fixture = std::make_unique<MixerFixture> (size);
+        else if (name == "synth")                   fixture = std::make_unique<SynthFixture> (size, false);
+        else if (name == "dispatch")                fixture = std::make_unique<SynthFixture> (size, true);
+
+        jassert (fixture != nullptr);
+        return fixture;
+    }
+
+    /** Returns the median time per sample of output, in nanoseconds. */
+    double measure (Fixture& fixture, int blockSize, double sampleRate) const
+    {
+        constexpr auto numWarmUpBlocks = 16;
+        const auto blocksPerRestart = jmax (1, (int) (sampleRate / blockSize));
+        auto blocksSinceRestart = 0;
+
+        auto renderBlock = [&]
+        {
+            if (++blocksSinceRestart >= blocksPerRestart)
+            {
+                fixture.restart();
+                blocksSinceRestart = 0;
+            }
+
+            fixture.renderBlock();
+        };
+
+        for (auto i = 0; i < numWarmUpBlocks; ++i)
+            renderBlock();
+
+        const auto ticksPerSecond = (double) Time::getHighResolutionTicksPerSecond();
+        const auto minimumTicks = (int64) (settings.secondsPerTrial * ticksPerSecond);
+        std::vector<double> trials;
+
+        for (auto trial = 0; trial < jmax (1, settings.numTrials); ++trial)
+        {
+            const auto startTicks = Time::getHighResolutionTicks();
+            int64 numBlocks = 0, elapsedTicks = 0;
+
+            do
+            {
+                renderBlock();
+                ++numBlocks;
+                elapsedTicks = Time::getHighResolutionTicks() - startTicks;
+            }
+            while (elapsedTicks < minimumTicks);
+
+            trials.push_back (1.0e9 * (double) elapsedTicks / ticksPerSecond / (double) (numBlocks * blockSize));
+        }
+
+        std::sort (trials.begin(), trials.end());
+        return trials[trials.size() / 2];
+    }
+
+    BenchmarkSettings settings;
+    WavetableBank wavetables;
+    SincResampler resampler;
+
+    JUCE_DECLARE_NON_COPYABLE (SynthBenchmarks)
+};
@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    This file contains the synth's parameter set, and the lock-free channel used
+    to hand it from the message thread to the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "WavetableBank.h"
+#include "BlockEnvelope.h"
+#include "SincResampler.h"
+#include "VoiceModulation.h"
+#include "StateVariableFilter.h"
+
+//==============================================================================
+/**
+    A single-writer, single-reader triple buffer.
+
+    The writer always has a slot of its own to fill, the reader always has a
+    consistent slot of its own to read, and the third slot is swapped between them
+    with one atomic exchange. Neither side ever waits for the other, and the reader
+    only ever sees complete values, though it may skip some if the writer publishes
+    faster than it reads.
+*/
+template <typename Type>
+class TripleBuffer
+{
+public:
+    explicit TripleBuffer (const Type& initialValue = {})
+    {
+        buffers.fill (initialValue);
+    }
+
+    /** Writer side: publishes a new value. */
+    void write (const Type& newValue) noexcept
+    {
+        buffers[(size_t) writeIndex] = newValue;
+        writeIndex = sharedIndex.exchange (writeIndex | newDataFlag) & indexMask;
+    }
+
+    /** Reader side: picks up the latest published value, if there is one.
+        Returns true if the value returned by read() has changed.
+    */
+    bool pull() noexcept
+    {
+        if ((sharedIndex.load (std::memory_order_relaxed) & newDataFlag) == 0)
+            return false;
+
+        readIndex = sharedIndex.exchange (readIndex) & indexMask;
+        return true;
+    }
+
+    /** Reader side: the value picked up by the last call to pull(). It stays valid
+        and unchanged until pull() is called again.
+    */
+    const Type& read() const noexcept       { return buffers[(size_t) readIndex]; }
+
+private:
+    static_assert (std::is_trivially_copyable_v<Type>, "Copying the value mustn't allocate or lock");
+
+    static constexpr int newDataFlag = 4, indexMask = 3;
+
+    std::array<Type, 3> buffers;
+    int writeIndex = 0, readIndex = 1;
+    std::atomic<int> sharedIndex { 2 };
+
+    JUCE_DECLARE_NON_COPYABLE (TripleBuffer)
+};
+
+//==============================================================================
+/** Everything the GUI can change about the synth's sound. */
+struct SynthParameters
+{
+    ADSR::Parameters envelope { 0.1f, 0.8f, 0.8f, 0.8f };
+    BlockEnvelope::Curve envelopeCurve = BlockEnvelope::Curve::linear;
+    WavetableBank::Waveform waveform = WavetableBank::sine;
+    bool useSampledSound = false;
+    ResamplingQuality resamplingQuality = ResamplingQuality::standard;
+    float volume = 1.0f;
+    FilterType filterType = FilterType::lowPass;
+    float cutoff = 1000.0f;     // the voices' filter cutoff, in Hz
+    float resonance = 0.7f;     // the voices' filter Q
+    float filterDrive = 1.0f;   // how hard the filters' inputs are saturated; 1 leaves them clean
+    ModulationParameters modulation;
+};
+
+//==============================================================================
+/**
+    Holds the synth parameters and publishes them to the audio thread.
+
+    The message thread edits its own copy with update(), which publishes a complete
+    snapshot each time. The audio thread calls pull() once at the start of each
+    block and then reads that snapshot, which can't change under it mid-block.
+*/
+class SynthParameterStore
+{
+public:
+    SynthParameterStore()  : snapshots (editedParameters) {}
+
+    /** Message thread: changes some parameters and publishes the result. */
+    template <typename Function>
+    void update (Function&& change)
+    {
+        change (editedParameters);
+        snapshots.write (editedParameters);
+    }
+
+    /** Message thread: the parameters as last set by update(). */
+    const SynthParameters& getEditedParameters() const noexcept     { return editedParameters; }
+
+    /** Audio thread: picks up the latest snapshot. Returns true if it changed. */
+    bool pull() noexcept                                            { return snapshots.pull(); }
+
+    /** Audio thread: the snapshot picked up by the last pull(). */
+    const SynthParameters& getSnapshot() const noexcept             { return snapshots.read(); }
+
+private:
+    SynthParameters editedParameters;
+    TripleBuffer<SynthParameters> snapshots;
+
+    JUCE_DECLARE_NON_COPYABLE (SynthParameterStore)
+};
@@ -0,0 +1,333 @@
+/*
+  ==============================================================================
+
+    This file contains the per-voice filters, which are run several voices at a
+    time in SIMD lanes.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "VoiceModulation.h"
+#include "StateVariableFilter.h"
+
+//==============================================================================
+/**
+    A resonant state-variable filter for every voice, processed one SIMD register's
+    worth of voices at a time.
+
+    The bank has a fixed number of slots, one for each channel a voice renders, and
+    puts them in groups of numLanes. Instead of mixing into the output, a voice adds
+    its block into its slot with addInput(), and tells the bank how far its own
+    modulation moves the cutoff with setCutoffScale(). endBlock() then interleaves
+    each group's slots, runs one filter pass per group on whole registers, so 4 or
+    8 voices cost about the same as one, and adds each lane into the output channels
+    it's routed to. Groups that nobody wrote to are skipped, and a lane's filter is
+    reset whenever its voice is silent.
+
+    The coefficients are worked out again for every cell of cellSize samples, from
+    the shared cutoff and Q times each lane's own scale. The filters are the
+    topology-preserving kind, so a cutoff that jumps between cells can't make them
+    blow up.
+
+    Voices may be rendered on several threads: everything a voice writes for a slot,
+    its input, its cutoff scales and the flag saying it was written, is on cache
+    lines of the slot's own, so voices on different threads never write to the
+    same line while they render. A slot's input is cleared when it's first
+    written in a block, so nothing from an earlier block can leak into it.
+*/
+class VoiceFilterBank
+{
+public:
+    using Lanes = dsp::SIMDRegister<float>;
+    static constexpr int numLanes = (int) Lanes::SIMDNumElements;
+    static constexpr int cellSize = VoiceModulator::controlInterval;
+
+    VoiceFilterBank() = default;
+
+    //==============================================================================
+    /** Allocates everything the bank needs. Call this from prepareToPlay(), and then
+        set the slots' routing; they all start off going to every channel.
+    */
+    void prepare (int newNumSlots, int newMaximumBlockSize, double newSampleRate)
+    {
+        numSlots = newNumSlots;
+        numGroups = (numSlots + numLanes - 1) / numLanes;
+        maximumBlockSize = newMaximumBlockSize;
+        numCells = (maximumBlockSize + cellSize - 1) / cellSize;
+        sampleRate = newSampleRate;
+
+        // each slot has its input, then its cutoff scales, each starting on a new cache line
+        slotScalesOffset = (maximumBlockSize + floatsPerCacheLine - 1) / floatsPerCacheLine;
+        slotStride = slotScalesOffset + (numCells + floatsPerCacheLine - 1) / floatsPerCacheLine;
+        slotData.assign ((size_t) (numGroups * numLanes * slotStride), {});
+
+        for (auto slot = 0; slot < numGroups * numLanes; ++slot)
+            std::fill_n (getCutoffScales (slot), numCells, 1.0f);
+
+        interleaved.assign ((size_t) maximumBlockSize, Lanes::expand (0.0f));
+        states.assign ((size_t) numGroups, {});
+        cellCutoffs.assign ((size_t) numCells, 0.0f);
+        cellResonances.assign ((size_t) numCells, 0.0f);
+        routing.assign ((size_t) (numGroups * numLanes), -1);
+        written.assign ((size_t) (numGroups * numLanes), {});
+        groupHasInput.assign ((size_t) numGroups, 0);
+    }
+
+    int getNumSlots() const noexcept        { return numSlots; }
+
+    /** Sends a slot to one output channel, or to all of them if channel is -1. A slot
+        routed past the last channel goes to the last one.
+    */
+    void setRouting (int slot, int channel) noexcept
+    {
+        jassert (isPositiveAndBelow (slot, numSlots));
+        routing[(size_t) slot] = channel;
+    }
+
+    //==============================================================================
+    /** Starts a block of up to the maximum block size, at startSample in the output
+        buffer. Call this on the audio thread before the voices render.
+    */
+    void beginBlock (int startSample, int numSamples) noexcept
+    {
+        jassert (numSamples <= maximumBlockSize);
+
+        blockStart = startSample;
+        blockSize = numSamples;
+
+        for (auto group = 0; group < numGroups; ++group)
+        {
+            if (! groupHasInput[(size_t) group])
+                continue;
+
+            // a voice only sets the cells it rendered, so the rest carry on from where it left off
+            for (auto lane = 0; lane < numLanes; ++lane)
+            {
+                auto* scales = getCutoffScales (group * numLanes + lane);
+                std::fill (scales, scales + numCells, scales[lastCell]);
+            }
+        }
+
+        lastCell = jmax (0, (numSamples - 1) / cellSize);
+        for (auto& flag : written)
+            flag.value = 0;
+    }
+
+    /** Adds numSamples of a voice's output, times gain, into a slot, starting at
+        startSample in the output buffer.
+    */
+    void addInput (int slot, int startSample, const float* source, float gain, int numSamples) noexcept
+    {
+        jassert (isPositiveAndBelow (slot, numSlots));
+        jassert (startSample >= blockStart && startSample + numSamples <= blockStart + blockSize);
+
+        auto* dest = getSlotInput (slot);
+
+        if (! written[(size_t) slot].value)
+        {
+            FloatVectorOperations::clear (dest, blockSize);
+            written[(size_t) slot].value = 1;
+        }
+
+        FloatVectorOperations::addWithMultiply (dest + (startSample - blockStart), source, gain, numSamples);
+    }
+
+    /** Sets the ratio a slot's filter cutoff is scaled by in every cell that overlaps
+        numSamples from startSample in the output buffer.
+    */
+    void setCutoffScale (int slot, int startSample, int numSamples, float scale) noexcept
+    {
+        jassert (isPositiveAndBelow (slot, numSlots));
+
+        auto* scales = getCutoffScales (slot);
+        const auto first = (startSample - blockStart) / cellSize;
+        const auto last  = (startSample - blockStart + numSamples - 1) / cellSize;
+
+        for (auto cell = first; cell <= last; ++cell)
+            scales[cell] = scale;
+    }
+
+    //==============================================================================
+    /** Filters everything the voices wrote in this block and adds it to the output.
+        The cutoff and resonance are advanced by the block's length.
+
+        With a drive above 1, each filter's input is boosted by it, saturated, and
+        brought back down again, so quiet notes stay clean and loud ones distort.
+    */
+    template <typename CutoffSmoothing>
+    void endBlock (AudioBuffer<float>& output, FilterType type, float drive,
+                   CutoffSmoothing& cutoff, SmoothedValue<float>& resonance) noexcept
+    {
+        ScopedNoDenormals noDenormals;
+
+        const auto numCellsThisTime = (blockSize + cellSize - 1) / cellSize;
+
+        for (auto cell = 0; cell < numCellsThisTime; ++cell)
+        {
+            const auto num = jmin (cellSize, blockSize - cell * cellSize);
+            cellCutoffs[(size_t) cell] = cutoff.skip (num);
+            cellResonances[(size_t) cell] = resonance.skip (num);
+        }
+
+        const auto numChannels = jmin (output.getNumChannels(), maxNumChannels);
+        float* channelData[maxNumChannels] {};
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+            channelData[channel] = output.getWritePointer (channel, blockStart);
+
+        auto* lanes = reinterpret_cast<float*> (interleaved.data());
+
+        for (auto group = 0; group < numGroups; ++group)
+        {
+            auto& state = states[(size_t) group];
+            auto writtenMask = Lanes::expand (0.0f);
+            groupHasInput[(size_t) group] = 0;
+
+            for (auto lane = 0; lane < numLanes; ++lane)
+            {
+                if (written[(size_t) (group * numLanes + lane)].value)
+                {
+                    writtenMask.set ((size_t) lane, 1.0f);
+                    groupHasInput[(size_t) group] = 1;
+                }
+            }
+
+            // a lane whose voice has finished starts its next note from silence
+            state.ic1eq = state.ic1eq * writtenMask;
+            state.ic2eq = state.ic2eq * writtenMask;
+
+            if (! groupHasInput[(size_t) group])
+                continue;
+
+            // interleave the slots' inputs, so that each sample is one register of voices
+            std::fill_n (interleaved.data(), blockSize, Lanes::expand (0.0f));
+
+            forEachWrittenLane (group, [&] (int lane, int slot)
+            {
+                const auto* input = getSlotInput (slot);
+
+                for (auto i = 0; i < blockSize; ++i)
+                    lanes[i * numLanes + lane] = input[i];
+            });
+
+            for (auto cell = 0; cell < numCellsThisTime; ++cell)
+            {
+                const auto cellStart = cell * cellSize;
+                const auto num = jmin (cellSize, blockSize - cellStart);
+
+                Coefficients c;
+                calculateCoefficients (group, cell, type, c);
+
+                for (auto i = cellStart; i < cellStart + num; ++i)
+                {
+                    const auto x = drive > 1.0f ? saturate (interleaved[(size_t) i], drive) : interleaved[(size_t) i];
+                    interleaved[(size_t) i] = state.process (x, c.a1, c.a2, c.a3, c.m0, c.m1, c.m2);
+                }
+            }
+
+            // and transpose them back, adding each lane into the channels it's routed to
+            forEachWrittenLane (group, [&] (int lane, int slot)
+            {
+                for (auto channel = 0; channel < numChannels; ++channel)
+                {
+                    if (! isRoutedTo (slot, channel, numChannels))
+                        continue;
+
+                    auto* dest = channelData[channel];
+
+                    for (auto i = 0; i < blockSize; ++i)
+                        dest[i] += lanes[i * numLanes + lane];
+                }
+            });
+        }
+    }
+
+private:
+    static constexpr int maxNumChannels = 2;     // the synth only ever renders in stereo
+    static constexpr int floatsPerCacheLine = 16;
+
+    struct alignas (64) CacheLine
+    {
+        float samples[floatsPerCacheLine];
+    };
+
+    struct alignas (64) SlotFlag
+    {
+        uint8 value = 0;
+    };
+
+    struct Coefficients
+    {
+        Lanes a1, a2, a3, m0, m1, m2;
+    };
+
+    float* getSlotInput (int slot) noexcept                 { return slotData[(size_t) (slot * slotStride)].samples; }
+    float* getCutoffScales (int slot) noexcept              { return slotData[(size_t) (slot * slotStride + slotScalesOffset)].samples; }
+    const float* getCutoffScales (int slot) const noexcept  { return slotData[(size_t) (slot * slotStride + slotScalesOffset)].samples; }
+
+    template <typename Callback>
+    void forEachWrittenLane (int group, Callback&& callback) noexcept
+    {
+        for (auto lane = 0; lane < numLanes; ++lane)
+        {
+            const auto slot = group * numLanes + lane;
+
+            if (slot < numSlots && written[(size_t) slot].value)
+                callback (lane, slot);
+        }
+    }
+
+    /** A cubic soft clipper, which levels off smoothly at +/-1, applied to x * drive
+        and scaled back by 1 / drive.
+    */
+    static Lanes saturate (Lanes x, float drive) noexcept
+    {
+        const auto limit = Lanes::expand (1.5f);
+        x = Lanes::min (limit, Lanes::max (Lanes::expand (-1.5f), x * drive));
+        return (x - x * x * x * (1.0f / 6.75f)) * (1.0f / drive);
+    }
+
+    /** Works out each lane's coefficients for one cell. */
+    void calculateCoefficients (int group, int cell, FilterType type, Coefficients& c) const noexcept
+    {
+        const auto q = cellResonances[(size_t) cell];
+        const auto baseFrequency = cellCutoffs[(size_t) cell] / (float) sampleRate;
+
+        for (auto lane = 0; lane < numLanes; ++lane)
+        {
+            SvfCoefficients coefficients;
+            coefficients.set (type, baseFrequency * getCutoffScales (group * numLanes + lane)[cell], q);
+
+            c.a1.set ((size_t) lane, coefficients.a1);
+            c.a2.set ((size_t) lane, coefficients.a2);
+            c.a3.set ((size_t) lane, coefficients.a3);
+            c.m0.set ((size_t) lane, coefficients.m0);
+            c.m1.set ((size_t) lane, coefficients.m1);
+            c.m2.set ((size_t) lane, coefficients.m2);
+        }
+    }
+
+    bool isRoutedTo (int slot, int channel, int numChannels) const noexcept
+    {
+        const auto target = routing[(size_t) slot];
+        return target < 0 || channel == jmin (target, numChannels - 1);
+    }
+
+    //==============================================================================
+    int numSlots = 0, numGroups = 0, numCells = 0, maximumBlockSize = 0;
+    int slotStride = 0, slotScalesOffset = 0;   // in cache lines
+    double sampleRate = 44100.0;
+    int blockStart = 0, blockSize = 0, lastCell = 0;
+
+    std::vector<CacheLine> slotData;    // [slot * slotStride], each slot's input, then its cutoff scales
+    std::vector<Lanes> interleaved;     // [sample], one lane per slot of the group being filtered
+    std::vector<SvfState<Lanes>> states;
+    std::vector<float> cellCutoffs, cellResonances;
+    std::vector<int> routing;
+    std::vector<SlotFlag> written;
+    std::vector<uint8> groupHasInput;
+
+    JUCE_DECLARE_NON_COPYABLE (VoiceFilterBank)
+};
@@ -0,0 +1,251 @@
+/*
+  ==============================================================================
+
+    This file contains the modulation the voices apply from pitch bend, MIDI
+    controllers and their own LFOs.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "OscillatorKernels.h"   // for the SYNTH_OSCILLATOR_USE_* instruction set checks
+#include "BlockEnvelope.h"
+
+//==============================================================================
+/**
+    The pitch wheel and controller values last received on one MIDI channel.
+
+    JUCE's Synthesiser doesn't keep controller values, so a note that starts after a
+    controller has moved wouldn't otherwise know where it is. PolySynthesiser keeps
+    one of these per channel, and voices read their note's channel while rendering.
+*/
+struct MidiChannelState
+{
+    enum Controller
+    {
+        modWheel    = 1,
+        volume      = 7,
+        expression  = 11,
+        brightness  = 74,
+        resetAllControllers = 121
+    };
+
+    MidiChannelState()      { reset(); }
+
+    /** Puts everything back where a freshly connected keyboard would have it; volume and
+        expression start at full, so that nothing changes for a player who never sends them.
+    */
+    void reset() noexcept
+    {
+        controllers.fill (0);
+        controllers[volume] = 127;
+        controllers[expression] = 127;
+        controllers[brightness] = 64;
+        pitchWheel = 8192;
+    }
+
+    /** Returns a controller's value scaled to [0, 1]. */
+    float getController (int controllerNumber) const noexcept
+    {
+        return (float) controllers[(size_t) controllerNumber] * (1.0f / 127.0f);
+    }
+
+    /** Returns the pitch wheel's position scaled to [-1, 1]. */
+    float getPitchBend() const noexcept
+    {
+        return (float) jmax (-8192, pitchWheel - 8192) * (1.0f / 8191.0f);
+    }
+
+    std::array<uint8, 128> controllers;
+    int pitchWheel = 8192;
+};
+
+//==============================================================================
+/** How far the MIDI controllers, the LFO and the filter envelope move the voices. */
+struct ModulationParameters
+{
+    float pitchBendRange = 2.0f;    // in semitones, each way
+    float lfoRate = 5.0f;           // in Hz
+    float vibratoDepth = 0.5f;      // in semitones, with the mod wheel all the way up
+    float tremoloDepth = 0.0f;      // as a fraction of the level, with the mod wheel all the way up
+    float brightnessRange = 2.0f;   // in octaves the filter cutoff moves each way from the brightness controller
+
+    ADSR::Parameters filterEnvelope { 0.01f, 0.3f, 0.0f, 0.3f };
+    float filterEnvelopeAmount = 0.0f;  // in octaves the cutoff rises at the envelope's peak
+};
+
+//==============================================================================
+/**
+    Works out one voice's pitch, level and filter cutoff modulation at control rate,
+    and hands it back as linear ramps for the voice to apply sample by sample.
+
+    Every controlInterval samples, the pitch bend, mod wheel, volume, expression and
+    brightness are read from the note's channel and combined with the voice's own
+    LFO and filter envelope, which costs a couple of exp2() calls and one sin()
+    however many samples are in the step. Each new value is approached in a straight
+    line from the previous one, so a stepped controller doesn't click and the LFO
+    comes out smooth.
+*/
+class VoiceModulator
+{
+public:
+    static constexpr int controlInterval = 64;
+
+    /** The values at the start and end of one control step. */
+    struct Ramp
+    {
+        float pitchStart = 1.0f, pitchEnd = 1.0f;   // as frequency ratios
+        float levelStart = 1.0f, levelEnd = 1.0f;
+        float cutoffStart = 1.0f, cutoffEnd = 1.0f; // as ratios of the filter's own cutoff
+    };
+
+    VoiceModulator() = default;
+
+    /** Starts a note, with the LFO at the start of its cycle and the control values
+        wherever the channel has them, so the note doesn't start with a glide.
+    */
+    void startNote (const MidiChannelState& channel, const ModulationParameters& parameters, double newSampleRate) noexcept
+    {
+        sampleRate = newSampleRate;
+        lfoPhase = 0.0f;
+        pitch = calculatePitch (channel, parameters, 0.0f);
+        steadyLevel = calculateSteadyLevel (channel);
+        level = steadyLevel * calculateTremolo (channel, parameters, 0.0f);
+
+        filterEnvelope.setSampleRate (sampleRate);
+        filterEnvelope.setParameters (parameters.filterEnvelope);
+        filterEnvelope.noteOn();
+        cutoff = calculateCutoff (channel, parameters, filterEnvelope.getCurrentLevel());
+    }
+
+    /** Releases the filter envelope, or resets it if the note is being cut off. */
+    void stopNote (bool allowTailOff) noexcept
+    {
+        if (allowTailOff)
+            filterEnvelope.noteOff();
+        else
+            filterEnvelope.reset();
+    }
+
+    /** Moves on by numSamples, which should be no more than controlInterval, and returns
+        the ramps to apply over them.
+    */
+    Ramp advance (const MidiChannelState& channel, const ModulationParameters& parameters, int numSamples) noexcept
+    {
+        jassert (numSamples <= controlInterval);
+
+        lfoPhase += (float) (parameters.lfoRate * numSamples / sampleRate);
+        lfoPhase -= std::floor (lfoPhase);
+
+        const auto lfo = std::sin (MathConstants<float>::twoPi * lfoPhase);
+
+        const auto envelopeLevel = filterEnvelope.skip (numSamples);
+
+        Ramp ramp;
+        ramp.pitchStart = pitch;
+        ramp.levelStart = level;
+        ramp.cutoffStart = cutoff;
+        ramp.pitchEnd = pitch = calculatePitch (channel, parameters, lfo);
+        steadyLevel = calculateSteadyLevel (channel);
+        ramp.levelEnd = level = steadyLevel * calculateTremolo (channel, parameters, lfo);
+        ramp.cutoffEnd = cutoff = calculateCutoff (channel, parameters, envelopeLevel);
+        return ramp;
+    }
+
+    /** The level the voice was last modulated to by volume and expression, for voice
+        stealing and deciding when a voice is silent. This leaves out the tremolo, so
+        that a trough in the LFO doesn't make a voice look quieter than it is.
+    */
+    float getCurrentLevel() const noexcept      { return steadyLevel; }
+
+    //==============================================================================
+    /** Multiplies a block by a straight line from start, stepping (end - start) /
+        numSamples every sample, so the next block can carry on from end.
+    */
+    static void multiplyByRamp (float* dest, float start, float end, int numSamples) noexcept
+    {
+        if (start == end)
+        {
+            if (start != 1.0f)
+                FloatVectorOperations::multiply (dest, start, numSamples);
+
+            return;
+        }
+
+        const auto step = (end - start) / (float) numSamples;
+        auto i = 0;
+
+       #if SYNTH_OSCILLATOR_USE_AVX2
+        auto values = _mm256_add_ps (_mm256_set1_ps (start),
+                                     _mm256_mul_ps (_mm256_set1_ps (step), _mm256_setr_ps (0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)));
+        const auto increment = _mm256_set1_ps (8.0f * step);
+
+        for (; i + 8 <= numSamples; i += 8)
+        {
+            _mm256_storeu_ps (dest + i, _mm256_mul_ps (_mm256_loadu_ps (dest + i), values));
+            values = _mm256_add_ps (values, increment);
+        }
+       #elif SYNTH_OSCILLATOR_USE_SSE2
+        auto values = _mm_setr_ps (start, start + step, start + 2.0f * step, start + 3.0f * step);
+        const auto increment = _mm_set1_ps (4.0f * step);
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            _mm_storeu_ps (dest + i, _mm_mul_ps (_mm_loadu_ps (dest + i), values));
+            values = _mm_add_ps (values, increment);
+        }
+       #elif SYNTH_OSCILLATOR_USE_NEON
+        const float initial[] = { start, start + step, start + 2.0f * step, start + 3.0f * step };
+        auto values = vld1q_f32 (initial);
+        const auto increment = vdupq_n_f32 (4.0f * step);
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            vst1q_f32 (dest + i, vmulq_f32 (vld1q_f32 (dest + i), values));
+            values = vaddq_f32 (values, increment);
+        }
+       #endif
+
+        for (; i < numSamples; ++i)
+            dest[i] *= start + step * (float) i;
+    }
+
+private:
+    static float calculatePitch (const MidiChannelState& channel, const ModulationParameters& parameters, float lfo) noexcept
+    {
+        const auto semitones = channel.getPitchBend() * parameters.pitchBendRange
+                             + lfo * parameters.vibratoDepth * channel.getController (MidiChannelState::modWheel);
+
+        return std::exp2 (semitones * (1.0f / 12.0f));
+    }
+
+    static float calculateSteadyLevel (const MidiChannelState& channel) noexcept
+    {
+        // squaring the controllers gives them a roughly even loudness taper
+        const auto volume = channel.getController (MidiChannelState::volume);
+        const auto expression = channel.getController (MidiChannelState::expression);
+
+        return volume * volume * expression * expression;
+    }
+
+    static float calculateTremolo (const MidiChannelState& channel, const ModulationParameters& parameters, float lfo) noexcept
+    {
+        const auto tremolo = parameters.tremoloDepth * channel.getController (MidiChannelState::modWheel);
+
+        return 1.0f - tremolo * (0.5f + 0.5f * lfo);
+    }
+
+    static float calculateCutoff (const MidiChannelState& channel, const ModulationParameters& parameters, float envelopeLevel) noexcept
+    {
+        const auto brightness = ((float) channel.controllers[MidiChannelState::brightness] - 64.0f) * (1.0f / 64.0f);
+
+        return std::exp2 (brightness * parameters.brightnessRange + envelopeLevel * parameters.filterEnvelopeAmount);
+    }
+
+    double sampleRate = 44100.0;
+    float lfoPhase = 0.0f;          // in cycles
+    float pitch = 1.0f, level = 1.0f, cutoff = 1.0f;
+    float steadyLevel = 1.0f;       // level without the tremolo
+    BlockEnvelope filterEnvelope;
+};
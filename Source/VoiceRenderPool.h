@@ -0,0 +1,317 @@
+/*
+  ==============================================================================
+
+    This file contains the worker threads used to render synth voices in parallel.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "RealtimeAllocationDetector.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+//==============================================================================
+/**
+    A fixed set of realtime worker threads that render a batch of voices together
+    with the audio thread.
+
+    Each call to render() splits the voices into one contiguous run per thread, the
+    audio thread included. A thread works through its own run from the front, and
+    once that's empty it steals voices from the back of the others' runs, so a thread
+    that got a handful of cheap sine voices ends up helping one that got expensive
+    sampler voices. Every worker mixes into its own sub-mix buffer; the audio
+    thread mixes straight into the output, waits for the others on an atomic
+    counter, and then adds their sub-mixes in. Voices that send their output
+    somewhere else, like a VoiceFilterBank, can be rendered without the sub-mixes
+    being cleared or added at all.
+
+    Nothing in render() allocates, locks or makes a system call, except for waking a
+    worker that has given up spinning and gone to sleep between blocks.
+*/
+class VoiceRenderPool
+{
+public:
+    explicit VoiceRenderPool (int numWorkerThreads)
+        : numWorkers (jmax (1, numWorkerThreads))
+    {
+        participants.reset (new Participant[(size_t) numWorkers + 1]);
+
+        for (auto i = 0; i < numWorkers; ++i)
+            workers.add (new Worker (*this, i + 1));
+    }
+
+    ~VoiceRenderPool()
+    {
+        for (auto* worker : workers)
+        {
+            worker->signalThreadShouldExit();
+            worker->wakeUp.signal();
+        }
+
+        for (auto* worker : workers)
+            worker->stopThread (1000);
+    }
+
+    int getNumWorkerThreads() const noexcept    { return numWorkers; }
+
+    //==============================================================================
+    /** Allocates the sub-mix buffers and starts the threads if they aren't running yet.
+        Call this from prepareToPlay(), never while render() might be running.
+    */
+    void prepare (int numChannels, int maximumBlockSize, double sampleRate)
+    {
+        for (auto i = 0; i <= numWorkers; ++i)
+            participants[i].subMix.setSize (numChannels, maximumBlockSize);
+
+        // the workers keep spinning for up to half a block after finishing one, so at
+        // small block sizes they're usually awake when the next one arrives
+        spinTimeoutTicks = Time::secondsToHighResolutionTicks (0.5 * maximumBlockSize / sampleRate);
+
+        const auto options = Thread::RealtimeOptions{}.withApproximateAudioProcessingTime (maximumBlockSize, sampleRate);
+        allWorkersRunning = true;
+
+        for (auto* worker : workers)
+            if (! worker->isThreadRunning() && ! worker->startRealtimeThread (options))
+                if (! worker->startThread (Thread::Priority::highest))
+                    allWorkersRunning = false;
+    }
+
+    /** Returns true if render() can handle a block of this shape. */
+    bool canRender (const AudioBuffer<float>& output, int startSample, int numSamples) const noexcept
+    {
+        const auto& subMix = participants[1].subMix;
+        return allWorkersRunning && output.getNumChannels() <= subMix.getNumChannels() && startSample + numSamples <= subMix.getNumSamples();
+    }
+
+    /** Adds the output of all the given voices to a region of the output buffer, and
+        returns once they've all finished. Call this from the audio thread only.
+
+        If voiceStartSamples isn't null, it holds the sample each voice starts at,
+        somewhere in the region, for voices that have already rendered its beginning.
+
+        Pass false for voicesMixIntoOutput if the voices never write to the buffer
+        they're given, and the workers' sub-mixes will be skipped.
+    */
+    void render (SynthesiserVoice* const* voicesToRender, const int* voiceStartSamples, int numVoices,
+                 AudioBuffer<float>& output, int startSample, int numSamples,
+                 bool voicesMixIntoOutput = true) noexcept
+    {
+        jassert (canRender (output, startSample, numSamples));
+
+        jobVoices = voicesToRender;
+        jobUsesSubMixes = voicesMixIntoOutput;
+        jobVoiceStartSamples = voiceStartSamples;
+        jobOutput = &output;
+        jobStartSample = startSample;
+        jobNumSamples = numSamples;
+
+        const auto numParticipants = numWorkers + 1;
+
+        for (auto i = 0; i < numParticipants; ++i)
+        {
+            auto& participant = participants[i];
+            participant.hasOutput = false;
+            participant.range.store (makeRange ((uint32) (numVoices * i / numParticipants),
+                                                (uint32) (numVoices * (i + 1) / numParticipants)),
+                                     std::memory_order_relaxed);
+        }
+
+        numBusyWorkers.store (numWorkers, std::memory_order_relaxed);
+        generation.fetch_add (1);   // publishes the job to the workers
+
+        for (auto* worker : workers)
+            if (worker->isSleeping.load())
+                worker->wakeUp.signal();
+
+        renderParticipant (0);
+
+        while (numBusyWorkers.load (std::memory_order_acquire) > 0)
+            pause();
+
+        if (! voicesMixIntoOutput)
+            return;
+
+        for (auto i = 1; i < numParticipants; ++i)
+        {
+            const auto& participant = participants[i];
+
+            if (participant.hasOutput)
+                for (auto channel = output.getNumChannels(); --channel >= 0;)
+                    output.addFrom (channel, startSample, participant.subMix, channel, startSample, numSamples);
+        }
+    }
+
+private:
+    //==============================================================================
+    struct alignas (64) Participant
+    {
+        // the run of voices this thread still has to render: begin in the low half, end in the high half
+        std::atomic<uint64> range { 0 };
+        AudioBuffer<float> subMix;
+        bool hasOutput = false;
+    };
+
+    struct Worker final : public Thread
+    {
+        Worker (VoiceRenderPool& ownerIn, int indexIn)
+            : Thread ("Voice render worker " + String (indexIn)), owner (ownerIn), index (indexIn)
+        {
+        }
+
+        void run() override
+        {
+            // render() can't be called until every worker has been started, so no job
+            // can have been posted before this thread got here
+            uint32 lastGeneration = 0;
+
+            while (waitForJob (lastGeneration))
+            {
+                owner.renderParticipant (index);
+                owner.numBusyWorkers.fetch_sub (1, std::memory_order_release);
+            }
+        }
+
+        bool waitForJob (uint32& lastGeneration)
+        {
+            while (! threadShouldExit())
+            {
+                const auto spinStart = Time::getHighResolutionTicks();
+
+                do
+                {
+                    if (owner.generation.load (std::memory_order_acquire) != lastGeneration)
+                    {
+                        ++lastGeneration;
+                        return true;
+                    }
+
+                    pause();
+                }
+                while (Time::getHighResolutionTicks() - spinStart < owner.spinTimeoutTicks.load (std::memory_order_relaxed));
+
+                // isSleeping is set before the last check, and the audio thread bumps the
+                // generation before reading it, so one of the two always sees the other
+                isSleeping.store (true);
+
+                if (owner.generation.load() == lastGeneration)
+                    wakeUp.wait (100);
+
+                isSleeping.store (false);
+            }
+
+            return false;
+        }
+
+        VoiceRenderPool& owner;
+        const int index;
+        std::atomic<bool> isSleeping { false };
+        WaitableEvent wakeUp;
+    };
+
+    //==============================================================================
+    static uint64 makeRange (uint32 begin, uint32 end) noexcept    { return ((uint64) end << 32) | begin; }
+
+    static void pause() noexcept
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #elif JUCE_ARM && (JUCE_CLANG || JUCE_GCC)
+        __asm__ __volatile__ ("yield");
+       #endif
+    }
+
+    /** Takes the next voice from the front of a participant's own run. */
+    static int takeFront (Participant& participant) noexcept
+    {
+        auto range = participant.range.load (std::memory_order_relaxed);
+
+        for (;;)
+        {
+            const auto begin = (uint32) range, end = (uint32) (range >> 32);
+
+            if (begin >= end)
+                return -1;
+
+            if (participant.range.compare_exchange_weak (range, makeRange (begin + 1, end), std::memory_order_relaxed))
+                return (int) begin;
+        }
+    }
+
+    /** Steals a voice from the back of another participant's run. */
+    static int takeBack (Participant& participant) noexcept
+    {
+        auto range = participant.range.load (std::memory_order_relaxed);
+
+        for (;;)
+        {
+            const auto begin = (uint32) range, end = (uint32) (range >> 32);
+
+            if (begin >= end)
+                return -1;
+
+            if (participant.range.compare_exchange_weak (range, makeRange (begin, end - 1), std::memory_order_relaxed))
+                return (int) end - 1;
+        }
+    }
+
+    int takeNextVoice (int participantIndex) noexcept
+    {
+        if (auto voice = takeFront (participants[participantIndex]); voice >= 0)
+            return voice;
+
+        const auto numParticipants = numWorkers + 1;
+
+        for (auto i = 1; i < numParticipants; ++i)
+            if (auto voice = takeBack (participants[(participantIndex + i) % numParticipants]); voice >= 0)
+                return voice;
+
+        return -1;
+    }
+
+    void renderParticipant (int participantIndex) noexcept
+    {
+        RealtimeAllocationDetector::ScopedRealtimeSection realtimeSection;
+        ScopedNoDenormals noDenormals;
+
+        auto& participant = participants[participantIndex];
+        auto& mix = participantIndex == 0 ? *jobOutput : participant.subMix;
+
+        for (auto voice = takeNextVoice (participantIndex); voice >= 0; voice = takeNextVoice (participantIndex))
+        {
+            if (! participant.hasOutput && participantIndex != 0 && jobUsesSubMixes)
+                for (auto channel = jobOutput->getNumChannels(); --channel >= 0;)
+                    mix.clear (channel, jobStartSample, jobNumSamples);
+
+            participant.hasOutput = true;
+
+            const auto start = jobVoiceStartSamples != nullptr ? jobVoiceStartSamples[voice] : jobStartSample;
+            const auto end = jobStartSample + jobNumSamples;
+
+            if (start < end)
+                jobVoices[voice]->renderNextBlock (mix, start, end - start);
+        }
+    }
+
+    //==============================================================================
+    const int numWorkers;
+    std::unique_ptr<Participant[]> participants;
+    OwnedArray<Worker> workers;
+
+    // the current job, written by the audio thread before it bumps the generation
+    SynthesiserVoice* const* jobVoices = nullptr;
+    const int* jobVoiceStartSamples = nullptr;
+    AudioBuffer<float>* jobOutput = nullptr;
+    int jobStartSample = 0, jobNumSamples = 0;
+    bool jobUsesSubMixes = true;
+
+    std::atomic<uint32> generation { 0 };
+    std::atomic<int> numBusyWorkers { 0 };
+    std::atomic<int64> spinTimeoutTicks { 0 };
+    bool allWorkersRunning = false;
+
+    JUCE_DECLARE_NON_COPYABLE (VoiceRenderPool)
+};
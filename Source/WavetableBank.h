@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    This file contains the band-limited wavetables used by SineWaveVoice.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/**
+    A set of precomputed, mip-mapped single-cycle tables for the demo's waveforms.
+
+    Each waveform has one table per octave. Level 0 holds every harmonic a table of
+    this size can represent, and each level above it holds half as many, so picking
+    the level from the phase increment keeps all harmonics below Nyquist. Tables are
+    built by additive synthesis once and are then read-only, so a single bank can be
+    shared by every voice. The tables don't depend on the sample rate.
+
+    The waveform indexes match SineWaveVoice::WaveType.
+*/
+class WavetableBank
+{
+public:
+    enum Waveform { sine, square, sawtooth, triangle, numWaveforms };
+
+    static constexpr int tableSize = 2048;
+    static constexpr int numLevels = 11;   // level n holds (tableSize / 2) >> n harmonics
+
+    WavetableBank() = default;
+
+    /** Builds the tables. This allocates, so call it from prepareToPlay(), never from the
+        audio thread. Does nothing if the tables have already been built.
+    */
+    void build()
+    {
+        if (isBuilt())
+            return;
+
+        const auto stride = (size_t) (tableSize + 1);
+        std::vector<float> newTables ((size_t) (numWaveforms * numLevels) * stride, 0.0f);
+
+        // every harmonic lands exactly on a sample of this basic cycle, so the tables
+        // can be summed without calling sin() once per sample per harmonic
+        std::vector<float> sineCycle ((size_t) tableSize);
+
+        for (auto i = 0; i < tableSize; ++i)
+            sineCycle[(size_t) i] = (float) std::sin (MathConstants<double>::twoPi * i / tableSize);
+
+        for (auto wave = 0; wave < numWaveforms; ++wave)
+        {
+            for (auto level = 0; level < numLevels; ++level)
+            {
+                auto* table = newTables.data() + (size_t) (wave * numLevels + level) * stride;
+                const auto numHarmonics = (tableSize / 2) >> level;
+
+                for (auto harmonic = 1; harmonic < numHarmonics || harmonic == 1; ++harmonic)
+                {
+                    const auto amplitude = getHarmonicAmplitude (wave, harmonic);
+
+                    if (amplitude == 0.0f)
+                        continue;
+
+                    // triangle is a cosine series, everything else is a sine series
+                    const auto offset = wave == triangle ? tableSize / 4 : 0;
+
+                    for (auto i = 0; i < tableSize; ++i)
+                        table[i] += amplitude * sineCycle[(size_t) ((harmonic * i + offset) & (tableSize - 1))];
+                }
+
+                table[tableSize] = table[0]; // guard point for the interpolation
+            }
+        }
+
+        tables = std::move (newTables);
+    }
+
+    bool isBuilt() const noexcept       { return ! tables.empty(); }
+
+    /** Returns the table to use for a waveform played at the given frequency.
+
+        The returned table has tableSize + 1 entries, the last one repeating the first.
+    */
+    const float* getTable (int waveform, double cyclesPerSample) const noexcept
+    {
+        jassert (isBuilt() && isPositiveAndBelow (waveform, (int) numWaveforms));
+
+        const auto maxHarmonics = 0.5 / jmax (cyclesPerSample, 1.0e-9);
+        auto level = 0;
+
+        while (level < numLevels - 1 && (double) ((tableSize / 2) >> level) > maxHarmonics)
+            ++level;
+
+        return tables.data() + (size_t) (waveform * numLevels + level) * (size_t) (tableSize + 1);
+    }
+
+    /** Reads a table at a phase in the range [0, 1) with linear interpolation. */
+    static float lookup (const float* table, float phase) noexcept
+    {
+        const auto position = phase * (float) tableSize;
+        const auto index = (int) position;
+        const auto fraction = position - (float) index;
+
+        return table[index] + fraction * (table[index + 1] - table[index]);
+    }
+
+private:
+    static float getHarmonicAmplitude (int waveform, int harmonic) noexcept
+    {
+        const auto isOdd = (harmonic & 1) != 0;
+
+        switch (waveform)
+        {
+            case sine:      return harmonic == 1 ? 1.0f : 0.0f;
+            case square:    return isOdd ? (float) (4.0 / (MathConstants<double>::pi * harmonic)) : 0.0f;
+            case sawtooth:  return (float) (-2.0 / (MathConstants<double>::pi * harmonic));
+            case triangle:  return isOdd ? (float) (8.0 / (MathConstants<double>::pi * MathConstants<double>::pi * harmonic * harmonic)) : 0.0f;
+            default:        break;
+        }
+
+        return 0.0f;
+    }
+
+    std::vector<float> tables;
+
+    JUCE_DECLARE_NON_COPYABLE (WavetableBank)
+};